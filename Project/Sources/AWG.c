@@ -3,13 +3,13 @@
  * \brief Implementation of AWG
  * \author Xu Waycell
  */
-#include <stdlib.h>
 #include <math.h>
 #include <mc9s12a512.h>
 
 #include "AWG.h"
 #include "timer.h"
 #include "analog.h"
+#include "OS.h"
 
 #ifdef NO_INTERRUPT
 #error "AWG module depends on interrupt feature enabled."
@@ -21,271 +21,173 @@
 
 #define AWG_ARBITRARY_WAVE_INITIAL_VOLTAGE 0
 
-#define AWG_SINE_WAVE_SIZE  1000
+#define AWG_SINE_QUARTER_BITS 8 /* 6 selects the smaller table */
+#define AWG_SINE_QUARTER_SIZE (1 << AWG_SINE_QUARTER_BITS)
+#define AWG_SINE_FRACTION_BITS (14 - AWG_SINE_QUARTER_BITS) /* phase bits left below table index within a quarter */
+#define AWG_SINE_FRACTION_MASK ((1 << AWG_SINE_FRACTION_BITS) - 1)
+
+#define AWG_PHASE_HALF         0x80000000 /* half period of phase accumulator */
+#define AWG_PHASE_STEP_DIVISOR 78125      /* 10^7 / 2^7 */
+
+#define AWG_DISPATCH_MINIMUM_INTERVAL 100  /* microseconds, channels due within it are served together */
+#define AWG_DISPATCH_MAXIMUM_INTERVAL 1000 /* microseconds, keeps timer compare within 16 bits */
+
+#define AWG_PHASOR_SYNTHESIS_CHUNK 4 /* samples synthesized every time render thread wakes up */
+
+#define AWG_Q15_MAXIMUM 32767
+#define AWG_Q15_MINIMUM -32768
+#define AWG_Q15_ROUND   0x4000
+
+#define AWG_NOISE_SEED           0x2545F491 /* any non-zero value will do */
+#define AWG_NOISE_GAUSSIAN_SCALE 37837      /* sqrt(12) / 3 in Q15 */
 
 typedef struct
 {
-  BOOL isRunning;
-
   TAWGWaveformType waveformType;
-  UINT16 amplitude;
-  INT16 offset;
+  TAWGNoiseType noiseType;
+  UINT8 arbitrarySlot;
+  BOOL isDeferred;  /* held back until phase wraps to the next period */
+  
+  UINT16 frequency; /* ModCon frequency the tuning word was made for */
+  UINT32 phaseStep; /* tuning word, taken over unless a sweep is running */
+  UINT32 period;    /* sample period in bus clock cycles */
+    
+  INT16 gain; /* Q15 gain, peak voltage in DAC counts for a full scale shape */
+  INT16 bias; /* DAC zero voltage with offset folded in */
+  
+} TAWGParameters;
 
-	UINT32 frequencyPeriod; /* frequency period in microseconds */
-	UINT32 halfFrequencyPeriod;
-	UINT32 time;
-	UINT32 timeStep;
+typedef struct
+{
+  BOOL isRunning;
 
-    
-  INT16 voltage;
-  INT16 voltageScale;
-  INT16 voltageOffset;
+  TAWGParameters parameters[2]; /* published set is used by render thread, the other one is staged */
+  volatile UINT8 published;     /* index of published set, flipped only by render thread */
+  volatile BOOL isStaged;       /* staged set is complete and may be published */
+
+  UINT32 phase;     /* phase accumulator, 2^32 represents a full period */
+  UINT32 phaseStep; /* tuning word added to phase accumulator every sample */
+  
+  TAWGSweepProfile sweepProfile;
+  BOOL isSweepRising;
+  UINT16 sweepTarget;            /* ModCon frequency at the end of sweep */
+  UINT32 sweepRemaining;         /* samples left until sweep ends */
+  UINT32 sweepStop;              /* tuning word at the end of sweep */
+  UINT32 sweepIncrement;         /* linear: tuning word change per sample, logarithmic: ratio - 1 in Q32 */
+  UINT16 sweepIncrementFraction; /* linear: tuning word change per sample below 1, in 1/65536 */
+  UINT16 sweepFraction;          /* linear: accumulated fraction of tuning word */
+  
+  INT32 countdown;  /* bus clock cycles until next sample is due */
+  UINT32 period;    /* sample period in bus clock cycles the AWG routine plays at, owned by AWG routine */
+  
+  UINT32 noiseState; /* xorshift generator state */
     
 } TAWGEntryContext;
 
+typedef struct
+{
+  volatile UINT8 head; /* free running write index, owned by render thread */
+  volatile UINT8 tail; /* free running read index, owned by AWG routine */
+  
+  UINT32 headPeriod;              /* sample period samples at head are rendered for, render thread changes it only while no switch is pending */
+  volatile UINT8 periodIndex;     /* free running index of first sample rendered for headPeriod */
+  volatile BOOL isPeriodPending;  /* raised by render thread, AWG routine drops it once it has switched */
+  
+  UINT16 underrunCount;
+  
+  INT16 sample[AWG_SAMPLE_BUFFER_SIZE];
+  
+} TAWGSampleBuffer;
+
+typedef struct
+{
+  UINT16 gain;        /* Q15 reciprocal of phasor magnitude, 0 if harmonic is not staged */
+  UINT16 phaseOffset; /* 65536 represents a full period */
+  
+} TAWGPhasor;
+
+typedef struct
+{
+  TAWGPhasor phasor[AWG_NB_HARMONICS]; /* staged phasors of harmonics 1 to AWG_NB_HARMONICS */
+  
+  UINT16 sampleIndex; /* next arbitrary wave sample to synthesize */
+  BOOL isPending;
+  
+} TAWGPhasorSynthesis;
+
 typedef struct
 {
   UINT32 busClk;  
   UINT16 scale;  
   UINT16 sampleRate;  
-  UINT16 routinePeriod;
+  UINT16 routinePeriod; /* bus clock cycles since last dispatch */
+  UINT16 minimumInterval;
+  UINT16 maximumInterval;
   
 } TAWGRuntimeContext;
 
 TAWGEntry AWG_Channel[NB_AWG_CHANNELS] = {0};
 TAWGEntryContext AWGChannelContext[NB_AWG_CHANNELS] = {0};
 TAWGRuntimeContext AWGRuntimeContext = {0};
+TAWGSampleBuffer AWGSampleBuffer[NB_AWG_CHANNELS] = {0};
+
+static OS_ECB* AWGRenderSemaphorePtr = (OS_ECB*) 0x0000;
+static volatile BOOL AWGRenderPending = bFALSE;
+
+INT16 AWG_WaveSlot[AWG_NB_WAVE_SLOTS][AWG_ARBITRARY_WAVE_SIZE] = {0};
+
+TAWGPhasorSynthesis AWGPhasorSynthesis[AWG_NB_WAVE_SLOTS] = {0};
+static volatile BOOL AWGSynthesisPending = bFALSE;
 
-//INT32 AWG_ARBITRARY_WAVE[AWG_ARBITRARY_WAVE_SIZE] = {0};
 
 static TAWGPostProcessRoutine channelPostProcessRoutinePtr = (TAWGPostProcessRoutine) 0x0000;
 
-/* url: http://www.meraman.com/htmls/en/sinTableOld.html */
-const INT16 AWG_SINEWAVE[AWG_SINE_WAVE_SIZE] =
-{
-  0, 129, 257, 386, 515, 643, 772, 900, 1029, 1157, 1286,
-  1414, 1543, 1671, 1799, 1927, 2055, 2183, 2311, 2439, 2567,
-  2694, 2822, 2949, 3077, 3204, 3331, 3458, 3584, 3711, 3838,
-  3964, 4090, 4216, 4342, 4468, 4593, 4718, 4843, 4968, 5093,
-  5218, 5342, 5466, 5590, 5714, 5837, 5960, 6083, 6206, 6329,
-  6451, 6573, 6695, 6816, 6937, 7058, 7179, 7299, 7419, 7539,
-  7659, 7778, 7897, 8015, 8134, 8252, 8369, 8486, 8603, 8720,
-  8836, 8952, 9068, 9183, 9298, 9412, 9526, 9640, 9753, 9866,
-  9979, 10091, 10203, 10314, 10425, 10536, 10646, 10756, 10865,
-  10974, 11082, 11190, 11298, 11405, 11511, 11618, 11723, 11829,
-  11934, 12038, 12142, 12245, 12348, 12450, 12552, 12654, 12755,
-  12855, 12955, 13054, 13153, 13252, 13350, 13447, 13544, 13640,
-  13736, 13831, 13925, 14020, 14113, 14206, 14298, 14390, 14482,
-  14572, 14662, 14752, 14841, 14929, 15017, 15104, 15191, 15277,
-  15362, 15447, 15531, 15615, 15698, 15780, 15862, 15943, 16023,
-  16103, 16182, 16261, 16339, 16416, 16493, 16569, 16644, 16719,
-  16793, 16866, 16939, 17011, 17082, 17153, 17223, 17292, 17360,
-  17428, 17496, 17562, 17628, 17693, 17758, 17821, 17884, 17947,
-  18008, 18069, 18130, 18189, 18248, 18306, 18363, 18420, 18476,
-  18531, 18585, 18639, 18692, 18744, 18796, 18846, 18896, 18946,
-  18994, 19042, 19089, 19135, 19181, 19225, 19269, 19312, 19355,
-  19397, 19437, 19478, 19517, 19556, 19593, 19631, 19667, 19702,
-  19737, 19771, 19804, 19837, 19868, 19899, 19929, 19958, 19987,
-  20014, 20041, 20067, 20093, 20117, 20141, 20164, 20186, 20207,
-  20228, 20248, 20267, 20285, 20302, 20319, 20334, 20349, 20363,
-  20377, 20389, 20401, 20412, 20422, 20431, 20440, 20447, 20454,
-  20460, 20465, 20470, 20474, 20476, 20478, 20480, 20480, 20480,
-  20478, 20476, 20474, 20470, 20465, 20460, 20454, 20447, 20440,
-  20431, 20422, 20412, 20401, 20389, 20377, 20363, 20349, 20334,
-  20319, 20302, 20285, 20267, 20248, 20228, 20207, 20186, 20164,
-  20141, 20117, 20093, 20067, 20041, 20014, 19987, 19958, 19929,
-  19899, 19868, 19837, 19804, 19771, 19737, 19702, 19667, 19631,
-  19593, 19556, 19517, 19478, 19437, 19397, 19355, 19312, 19269,
-  19225, 19181, 19135, 19089, 19042, 18994, 18946, 18896, 18846,
-  18796, 18744, 18692, 18639, 18585, 18531, 18476, 18420, 18363,
-  18306, 18248, 18189, 18130, 18069, 18008, 17947, 17884, 17821,
-  17758, 17693, 17628, 17562, 17496, 17428, 17360, 17292, 17223,
-  17153, 17082, 17011, 16939, 16866, 16793, 16719, 16644, 16569,
-  16493, 16416, 16339, 16261, 16182, 16103, 16023, 15943, 15862,
-  15780, 15698, 15615, 15531, 15447, 15362, 15277, 15191, 15104,
-  15017, 14929, 14841, 14752, 14662, 14572, 14482, 14390, 14298,
-  14206, 14113, 14020, 13925, 13831, 13736, 13640, 13544, 13447,
-  13350, 13252, 13153, 13054, 12955, 12855, 12755, 12654, 12552,
-  12450, 12348, 12245, 12142, 12038, 11934, 11829, 11723, 11618,
-  11511, 11405, 11298, 11190, 11082, 10974, 10865, 10756, 10646,
-  10536, 10425, 10314, 10203, 10091, 9979, 9866, 9753, 9640, 9526,
-  9412, 9298, 9183, 9068, 8952, 8836, 8720, 8603, 8486, 8369, 8252,
-  8134, 8015, 7897, 7778, 7659, 7539, 7419, 7299, 7179, 7058, 6937,
-  6816, 6695, 6573, 6451, 6329, 6206, 6083, 5960, 5837, 5714, 5590,
-  5466, 5342, 5218, 5093, 4968, 4843, 4718, 4593, 4468, 4342, 4216,
-  4090, 3964, 3838, 3711, 3584, 3458, 3331, 3204, 3077, 2949, 2822,
-  2694, 2567, 2439, 2311, 2183, 2055, 1927, 1799, 1671, 1543, 1414,
-  1286, 1157, 1029, 900, 772, 643, 515, 386, 257, 129, 0, -129, -257,
-  -386, -515, -643, -772, -900, -1029, -1157, -1286, -1414, -1543, -1671,
-  -1799, -1927, -2055, -2183, -2311, -2439, -2567, -2694, -2822, -2949, -3077,
-  -3204, -3331, -3458, -3584, -3711, -3838, -3964, -4090, -4216, -4342, -4468,
-  -4593, -4718, -4843, -4968, -5093, -5218, -5342, -5466, -5590, -5714, -5837,
-  -5960, -6083, -6206, -6329, -6451, -6573, -6695, -6816, -6937, -7058, -7179,
-  -7299, -7419, -7539, -7659, -7778, -7897, -8015, -8134, -8252, -8369, -8486,
-  -8603, -8720, -8836, -8952, -9068, -9183, -9298, -9412, -9526, -9640, -9753,
-  -9866, -9979, -10091, -10203, -10314, -10425, -10536, -10646, -10756, -10865,
-  -10974, -11082, -11190, -11298, -11405, -11511, -11618, -11723, -11829, -11934,
-  -12038, -12142, -12245, -12348, -12450, -12552, -12654, -12755, -12855, -12955,
-  -13054, -13153, -13252, -13350, -13447, -13544, -13640, -13736, -13831, -13925,
-  -14020, -14113, -14206, -14298, -14390, -14482, -14572, -14662, -14752, -14841,
-  -14929, -15017, -15104, -15191, -15277, -15362, -15447, -15531, -15615, -15698,
-  -15780, -15862, -15943, -16023, -16103, -16182, -16261, -16339, -16416, -16493,
-  -16569, -16644, -16719, -16793, -16866, -16939, -17011, -17082, -17153, -17223,
-  -17292, -17360, -17428, -17496, -17562, -17628, -17693, -17758, -17821, -17884,
-  -17947, -18008, -18069, -18130, -18189, -18248, -18306, -18363, -18420, -18476,
-  -18531, -18585, -18639, -18692, -18744, -18796, -18846, -18896, -18946, -18994,
-  -19042, -19089, -19135, -19181, -19225, -19269, -19312, -19355, -19397, -19437,
-  -19478, -19517, -19556, -19593, -19631, -19667, -19702, -19737, -19771, -19804,
-  -19837, -19868, -19899, -19929, -19958, -19987, -20014, -20041, -20067, -20093,
-  -20117, -20141, -20164, -20186, -20207, -20228, -20248, -20267, -20285, -20302,
-  -20319, -20334, -20349, -20363, -20377, -20389, -20401, -20412, -20422, -20431,
-  -20440, -20447, -20454, -20460, -20465, -20470, -20474, -20476, -20478, -20480,
-  -20480, -20480, -20478, -20476, -20474, -20470, -20465, -20460, -20454, -20447,
-  -20440, -20431, -20422, -20412, -20401, -20389, -20377, -20363, -20349, -20334,
-  -20319, -20302, -20285, -20267, -20248, -20228, -20207, -20186, -20164, -20141,
-  -20117, -20093, -20067, -20041, -20014, -19987, -19958, -19929, -19899, -19868,
-  -19837, -19804, -19771, -19737, -19702, -19667, -19631, -19593, -19556, -19517,
-  -19478, -19437, -19397, -19355, -19312, -19269, -19225, -19181, -19135, -19089,
-  -19042, -18994, -18946, -18896, -18846, -18796, -18744, -18692, -18639, -18585,
-  -18531, -18476, -18420, -18363, -18306, -18248, -18189, -18130, -18069, -18008,
-  -17947, -17884, -17821, -17758, -17693, -17628, -17562, -17496, -17428, -17360,
-  -17292, -17223, -17153, -17082, -17011, -16939, -16866, -16793, -16719, -16644,
-  -16569, -16493, -16416, -16339, -16261, -16182, -16103, -16023, -15943, -15862,
-  -15780, -15698, -15615, -15531, -15447, -15362, -15277, -15191, -15104, -15017,
-  -14929, -14841, -14752, -14662, -14572, -14482, -14390, -14298, -14206, -14113,
-  -14020, -13925, -13831, -13736, -13640, -13544, -13447, -13350, -13252, -13153,
-  -13054, -12955, -12855, -12755, -12654, -12552, -12450, -12348, -12245, -12142,
-  -12038, -11934, -11829, -11723, -11618, -11511, -11405, -11298, -11190, -11082,
-  -10974, -10865, -10756, -10646, -10536, -10425, -10314, -10203, -10091, -9979,
-  -9866, -9753, -9640, -9526, -9412, -9298, -9183, -9068, -8952, -8836, -8720, -8603,
-  -8486, -8369, -8252, -8134, -8015, -7897, -7778, -7659, -7539, -7419, -7299, -7179,
-  -7058, -6937, -6816, -6695, -6573, -6451, -6329, -6206, -6083, -5960, -5837, -5714,
-  -5590, -5466, -5342, -5218, -5093, -4968, -4843, -4718, -4593, -4468, -4342, -4216,
-  -4090, -3964, -3838, -3711, -3584, -3458, -3331, -3204, -3077, -2949, -2822, -2694,
-  -2567, -2439, -2311, -2183, -2055, -1927, -1799, -1671, -1543, -1414, -1286, -1157,
-  -1029, -900, -772, -643, -515, -386, -257, -129
- 
- /* 
- 0, 13, 26, 39, 51, 64, 77, 90, 103, 116, 129, 141, 154, 167, 180, 193, 206, 218,
- 231, 244, 257, 269, 282, 295, 308, 320, 333, 346, 358, 371, 384, 396, 409, 422, 434,
- 447, 459, 472, 484, 497, 509, 522, 534, 547, 559, 571, 584, 596, 608, 621, 633, 645,
- 657, 669, 682, 694, 706, 718, 730, 742, 754, 766, 778, 790, 802, 813, 825, 837, 849,
- 860, 872, 884, 895, 907, 918, 930, 941, 953, 964, 975, 987, 998, 1009, 1020, 1031, 1043,
- 1054, 1065, 1076, 1086, 1097, 1108, 1119, 1130, 1140, 1151, 1162, 1172, 1183, 1193, 1204,
- 1214, 1225, 1235, 1245, 1255, 1265, 1275, 1286, 1296, 1305, 1315, 1325, 1335, 1345, 1354,
- 1364, 1374, 1383, 1393, 1402, 1411, 1421, 1430, 1439, 1448, 1457, 1466, 1475, 1484, 1493,
- 1502, 1510, 1519, 1528, 1536, 1545, 1553, 1561, 1570, 1578, 1586, 1594, 1602, 1610, 1618,
- 1626, 1634, 1642, 1649, 1657, 1664, 1672, 1679, 1687, 1694, 1701, 1708, 1715, 1722, 1729,
- 1736, 1743, 1750, 1756, 1763, 1769, 1776, 1782, 1788, 1795, 1801, 1807, 1813, 1819, 1825,
- 1831, 1836, 1842, 1848, 1853, 1859, 1864, 1869, 1874, 1880, 1885, 1890, 1895, 1899, 1904,
- 1909, 1914, 1918, 1923, 1927, 1931, 1935, 1940, 1944, 1948, 1952, 1956, 1959, 1963, 1967,
- 1970, 1974, 1977, 1980, 1984, 1987, 1990, 1993, 1996, 1999, 2001, 2004, 2007, 2009, 2012,
- 2014, 2016, 2019, 2021, 2023, 2025, 2027, 2028, 2030, 2032, 2033, 2035, 2036, 2038, 2039,
- 2040, 2041, 2042, 2043, 2044, 2045, 2045, 2046, 2047, 2047, 2047, 2048, 2048, 2048, 2048,
- 2048, 2048, 2048, 2047, 2047, 2047, 2046, 2045, 2045, 2044, 2043, 2042, 2041, 2040, 2039,
- 2038, 2036, 2035, 2033, 2032, 2030, 2028, 2027, 2025, 2023, 2021, 2019, 2016, 2014, 2012,
- 2009, 2007, 2004, 2001, 1999, 1996, 1993, 1990, 1987, 1984, 1980, 1977, 1974, 1970, 1967,
- 1963, 1959, 1956, 1952, 1948, 1944, 1940, 1935, 1931, 1927, 1923, 1918, 1914, 1909, 1904,
- 1899, 1895, 1890, 1885, 1880, 1874, 1869, 1864, 1859, 1853, 1848, 1842, 1836, 1831, 1825,
- 1819, 1813, 1807, 1801, 1795, 1788, 1782, 1776, 1769, 1763, 1756, 1750, 1743, 1736, 1729,
- 1722, 1715, 1708, 1701, 1694, 1687, 1679, 1672, 1664, 1657, 1649, 1642, 1634, 1626, 1618,
- 1610, 1602, 1594, 1586, 1578, 1570, 1561, 1553, 1545, 1536, 1528, 1519, 1510, 1502, 1493,
- 1484, 1475, 1466, 1457, 1448, 1439, 1430, 1421, 1411, 1402, 1393, 1383, 1374, 1364, 1354,
- 1345, 1335, 1325, 1315, 1305, 1296, 1286, 1275, 1265, 1255, 1245, 1235, 1225, 1214, 1204,
- 1193, 1183, 1172, 1162, 1151, 1140, 1130, 1119, 1108, 1097, 1086, 1076, 1065, 1054, 1043,
- 1031, 1020, 1009, 998, 987, 975, 964, 953, 941, 930, 918, 907, 895, 884, 872, 860, 849,
- 837, 825, 813, 802, 790, 778, 766, 754, 742, 730, 718, 706, 694, 682, 669, 657, 645,
- 633, 621, 608, 596, 584, 571, 559, 547, 534, 522, 509, 497, 484, 472, 459, 447, 434,
- 422, 409, 396, 384, 371, 358, 346, 333, 320, 308, 295, 282, 269, 257, 244, 231, 218,
- 206, 193, 180, 167, 154, 141, 129, 116, 103, 90, 77, 64, 51, 39, 26, 13, 0, -13, -26,
- -39, -51, -64, -77, -90, -103, -116, -129, -141, -154, -167, -180, -193, -206, -218,
- -231, -244, -257, -269, -282, -295, -308, -320, -333, -346, -358, -371, -384, -396,
- -409, -422, -434, -447, -459, -472, -484, -497, -509, -522, -534, -547, -559, -571,
- -584, -596, -608, -621, -633, -645, -657, -669, -682, -694, -706, -718, -730, -742,
- -754, -766, -778, -790, -802, -813, -825, -837, -849, -860, -872, -884, -895, -907,
- -918, -930, -941, -953, -964, -975, -987, -998, -1009, -1020, -1031, -1043, -1054,
- -1065, -1076, -1086, -1097, -1108, -1119, -1130, -1140, -1151, -1162, -1172, -1183,
- -1193, -1204, -1214, -1225, -1235, -1245, -1255, -1265, -1275, -1286, -1296, -1305,
- -1315, -1325, -1335, -1345, -1354, -1364, -1374, -1383, -1393, -1402, -1411, -1421,
- -1430, -1439, -1448, -1457, -1466, -1475, -1484, -1493, -1502, -1510, -1519, -1528,
- -1536, -1545, -1553, -1561, -1570, -1578, -1586, -1594, -1602, -1610, -1618, -1626,
- -1634, -1642, -1649, -1657, -1664, -1672, -1679, -1687, -1694, -1701, -1708, -1715,
- -1722, -1729, -1736, -1743, -1750, -1756, -1763, -1769, -1776, -1782, -1788, -1795,
- -1801, -1807, -1813, -1819, -1825, -1831, -1836, -1842, -1848, -1853, -1859, -1864,
- -1869, -1874, -1880, -1885, -1890, -1895, -1899, -1904, -1909, -1914, -1918, -1923,
- -1927, -1931, -1935, -1940, -1944, -1948, -1952, -1956, -1959, -1963, -1967, -1970,
- -1974, -1977, -1980, -1984, -1987, -1990, -1993, -1996, -1999, -2001, -2004, -2007,
- -2009, -2012, -2014, -2016, -2019, -2021, -2023, -2025, -2027, -2028, -2030, -2032,
- -2033, -2035, -2036, -2038, -2039, -2040, -2041, -2042, -2043, -2044, -2045, -2045,
- -2046, -2047, -2047, -2047, -2048, -2048, -2048, -2048, -2048, -2048, -2048, -2047,
- -2047, -2047, -2046, -2045, -2045, -2044, -2043, -2042, -2041, -2040, -2039, -2038,
- -2036, -2035, -2033, -2032, -2030, -2028, -2027, -2025, -2023, -2021, -2019, -2016,
- -2014, -2012, -2009, -2007, -2004, -2001, -1999, -1996, -1993, -1990, -1987, -1984,
- -1980, -1977, -1974, -1970, -1967, -1963, -1959, -1956, -1952, -1948, -1944, -1940,
- -1935, -1931, -1927, -1923, -1918, -1914, -1909, -1904, -1899, -1895, -1890, -1885,
- -1880, -1874, -1869, -1864, -1859, -1853, -1848, -1842, -1836, -1831, -1825, -1819,
- -1813, -1807, -1801, -1795, -1788, -1782, -1776, -1769, -1763, -1756, -1750, -1743,
- -1736, -1729, -1722, -1715, -1708, -1701, -1694, -1687, -1679, -1672, -1664, -1657,
- -1649, -1642, -1634, -1626, -1618, -1610, -1602, -1594, -1586, -1578, -1570, -1561,
- -1553, -1545, -1536, -1528, -1519, -1510, -1502, -1493, -1484, -1475, -1466, -1457,
- -1448, -1439, -1430, -1421, -1411, -1402, -1393, -1383, -1374, -1364, -1354, -1345,
- -1335, -1325, -1315, -1305, -1296, -1286, -1275, -1265, -1255, -1245, -1235, -1225,
- -1214, -1204, -1193, -1183, -1172, -1162, -1151, -1140, -1130, -1119, -1108, -1097,
- -1086, -1076, -1065, -1054, -1043, -1031, -1020, -1009, -998, -987, -975, -964, -953,
- -941, -930, -918, -907, -895, -884, -872, -860, -849, -837, -825, -813, -802, -790,
- -778, -766, -754, -742, -730, -718, -706, -694, -682, -669, -657, -645, -633, -621,
- -608, -596, -584, -571, -559, -547, -534, -522, -509, -497, -484, -472, -459, -447,
- -434, -422, -409, -396, -384, -371, -358, -346, -333, -320, -308, -295, -282, -269,
- -257, -244, -231, -218, -206, -193, -180, -167, -154, -141, -129, -116, -103, -90,
- -77, -64, -51, -39, -26, -13   
- */
+/* first quarter of sine period in Q15, the extra entry holds the peak for interpolation */
+#if AWG_SINE_QUARTER_BITS == 8
+const INT16 AWG_SINE_QUARTER[AWG_SINE_QUARTER_SIZE + 1] =
+{
+  0, 201, 402, 603, 804, 1005, 1206, 1407, 1608, 1809,
+  2009, 2210, 2410, 2611, 2811, 3012, 3212, 3412, 3612, 3811,
+  4011, 4210, 4410, 4609, 4808, 5007, 5205, 5404, 5602, 5800,
+  5998, 6195, 6393, 6590, 6786, 6983, 7179, 7375, 7571, 7767,
+  7962, 8157, 8351, 8545, 8739, 8933, 9126, 9319, 9512, 9704,
+  9896, 10087, 10278, 10469, 10659, 10849, 11039, 11228, 11417, 11605,
+  11793, 11980, 12167, 12353, 12539, 12725, 12910, 13094, 13279, 13462,
+  13645, 13828, 14010, 14191, 14372, 14553, 14732, 14912, 15090, 15269,
+  15446, 15623, 15800, 15976, 16151, 16325, 16499, 16673, 16846, 17018,
+  17189, 17360, 17530, 17700, 17869, 18037, 18204, 18371, 18537, 18703,
+  18868, 19032, 19195, 19357, 19519, 19680, 19841, 20000, 20159, 20317,
+  20475, 20631, 20787, 20942, 21096, 21250, 21403, 21554, 21705, 21856,
+  22005, 22154, 22301, 22448, 22594, 22739, 22884, 23027, 23170, 23311,
+  23452, 23592, 23731, 23870, 24007, 24143, 24279, 24413, 24547, 24680,
+  24811, 24942, 25072, 25201, 25329, 25456, 25582, 25708, 25832, 25955,
+  26077, 26198, 26319, 26438, 26556, 26674, 26790, 26905, 27019, 27133,
+  27245, 27356, 27466, 27575, 27683, 27790, 27896, 28001, 28105, 28208,
+  28310, 28411, 28510, 28609, 28706, 28803, 28898, 28992, 29085, 29177,
+  29268, 29358, 29447, 29534, 29621, 29706, 29791, 29874, 29956, 30037,
+  30117, 30195, 30273, 30349, 30424, 30498, 30571, 30643, 30714, 30783,
+  30852, 30919, 30985, 31050, 31113, 31176, 31237, 31297, 31356, 31414,
+  31470, 31526, 31580, 31633, 31685, 31736, 31785, 31833, 31880, 31926,
+  31971, 32014, 32057, 32098, 32137, 32176, 32213, 32250, 32285, 32318,
+  32351, 32382, 32412, 32441, 32469, 32495, 32521, 32545, 32567, 32589,
+  32609, 32628, 32646, 32663, 32678, 32692, 32705, 32717, 32728, 32737,
+  32745, 32752, 32757, 32761, 32765, 32766, 32767
 };
-
-/*
-const INT16 AWG_SINE_TABLE[256] = 
-{
-  0, 503, 1005, 1507, 2007, 2507, 3005,
-  3501, 3995, 4487, 4976, 5462, 5945, 6424,
-  6900, 7371, 7837, 8299, 8756, 9208, 9654,
-  10095, 10529, 10957, 11378, 11793, 12200, 12600,
-  12992, 13377, 13754, 14122, 14482, 14833, 15175,
-  15508, 15831, 16145, 16450, 16744, 17028, 17303,
-  17566, 17819, 18062, 18293, 18514, 18723, 18921,
-  19108, 19283, 19446, 19598, 19738, 19866, 19982,
-  20086, 20178, 20258, 20326, 20381, 20425, 20455,
-  20474, 20480, 20474, 20455, 20425, 20381, 20326,
-  20258, 20178, 20086, 19982, 19866, 19738, 19598,
-  19446, 19283, 19108, 18921, 18723, 18514, 18293,
-  18062, 17819, 17566, 17303, 17028, 16744, 16450,
-  16145, 15831, 15508, 15175, 14833, 14482, 14122,
-  13754, 13377, 12992, 12600, 12200, 11793, 11378,
-  10957, 10529, 10095, 9654, 9208, 8756, 8299,
-  7837, 7371, 6900, 6424, 5945, 5462, 4976,
-  4487, 3995, 3501, 3005, 2507, 2007, 1507,
-  1005, 503, 0, -503, -1005, -1507, -2007,
-  -2507, -3005, -3501, -3995, -4487, -4976,
-  -5462, -5945, -6424, -6900, -7371, -7837,
-  -8299, -8756, -9208, -9654, -10095, -10529,
-  -10957, -11378, -11793, -12200, -12600, -12992,
-  -13377, -13754, -14122, -14482, -14833, -15175,
-  -15508, -15831, -16145, -16450, -16744, -17028,
-  -17303, -17566, -17819, -18062, -18293, -18514,
-  -18723, -18921, -19108, -19283, -19446, -19598,
-  -19738, -19866, -19982, -20086, -20178, -20258,
-  -20326, -20381, -20425, -20455, -20474, -20480,
-  -20474, -20455, -20425, -20381, -20326, -20258,
-  -20178, -20086, -19982, -19866, -19738, -19598,
-  -19446, -19283, -19108, -18921, -18723, -18514,
-  -18293, -18062, -17819, -17566, -17303, -17028,
-  -16744, -16450, -16145, -15831, -15508, -15175,
-  -14833, -14482, -14122, -13754, -13377, -12992,
-  -12600, -12200, -11793, -11378, -10957, -10529,
-  -10095, -9654, -9208, -8756, -8299, -7837,
-  -7371, -6900, -6424, -5945, -5462, -4976,
-  -4487, -3995, -3501, -3005, -2507, -2007, 
-  -1507, -1005, -503
+#elif AWG_SINE_QUARTER_BITS == 6
+/* same resolution as the former 256-entry full period table */
+const INT16 AWG_SINE_QUARTER[AWG_SINE_QUARTER_SIZE + 1] =
+{
+  0, 804, 1608, 2410, 3212, 4011, 4808, 5602, 6393, 7179,
+  7962, 8739, 9512, 10278, 11039, 11793, 12539, 13279, 14010, 14732,
+  15446, 16151, 16846, 17530, 18204, 18868, 19519, 20159, 20787, 21403,
+  22005, 22594, 23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+  27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956, 30273, 30571,
+  30852, 31113, 31356, 31580, 31785, 31971, 32137, 32285, 32412, 32521,
+  32609, 32678, 32728, 32757, 32767
 };
- */
+#else
+#error "No sine table for selected AWG_SINE_QUARTER_BITS."
+#endif
  
 static TAnalogChannel outputChannelNumberLookupTable[NB_OUTPUT_CHANNELS] = { ANALOG_OUTPUT_Ch1,
                                                                              ANALOG_OUTPUT_Ch2,
@@ -294,15 +196,13 @@ static TAnalogChannel outputChannelNumberLookupTable[NB_OUTPUT_CHANNELS] = { ANA
 
 void AWGRoutine(TTimerChannel channelNb);
 
-float AWGGenerateAWGN(void);
-
 /**
- * \fn void AWGOutAnalog(TAnalogChannel channelNb, INT16 analogValue)
- * \brief Output given analog value to selected analog output channel
- * \param channelNb analog output channel number
+ * \fn INT16 AWGClampAnalog(INT32 analogValue)
+ * \brief Clamps given analog value into DAC output range
  * \param analogValue analog value
+ * \return clamped analog value
  */
-void AWGOutAnalog(TAnalogChannel channelNb, INT16 analogValue)
+INT16 AWGClampAnalog(INT32 analogValue)
 {
   if (analogValue > DAC_MAXIMUM)
   {
@@ -312,178 +212,562 @@ void AWGOutAnalog(TAnalogChannel channelNb, INT16 analogValue)
   {
   	analogValue = DAC_MINIMUM;
   }
-      
-  Analog_Put(channelNb, analogValue);  
+  
+  return (INT16)analogValue;
+}
+
+/**
+ * \fn INT16 AWGSine(const UINT16 phase)
+ * \brief Looks up sine of given phase from quarter wave table with linear interpolation
+ * \param phase phase angle, 65536 represents a full period
+ * \return sine value in Q15
+ */
+INT16 AWGSine(const UINT16 phase)
+{
+  UINT16 quarterPhase = 0, index = 0, fraction = 0;
+  INT16 value = 0;
+  
+  /* mirror second and fourth quarters, their range includes the peak entry */
+  if (phase & 0x4000)
+  {
+    quarterPhase = 0x4000 - (phase & 0x3FFF);
+  }
+  else
+  {
+    quarterPhase = phase & 0x3FFF;
+  }
+  
+  index = quarterPhase >> AWG_SINE_FRACTION_BITS;
+  fraction = quarterPhase & AWG_SINE_FRACTION_MASK;
+  
+  value = AWG_SINE_QUARTER[index];
+  
+  if (fraction)
+  {
+    value += (INT16)(((INT32)(AWG_SINE_QUARTER[index + 1] - value) * fraction) >> AWG_SINE_FRACTION_BITS);
+  }
+  
+  /* second half period is negative */
+  if (phase & 0x8000)
+  {
+    value = -value;
+  }
+  
+  return value;
+}
+
+/**
+ * \fn UINT32 AWGXorShift(UINT32* const statePtr)
+ * \brief Advances given xorshift generator state
+ * \param statePtr generator state, it must never be zero
+ * \return next 32 pseudo random bits
+ */
+UINT32 AWGXorShift(UINT32* const statePtr)
+{
+  UINT32 state = *statePtr;
+  
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  
+  *statePtr = state;
+  
+  return state;
+}
+
+/**
+ * \fn INT16 AWGNoise(const UINT16 index)
+ * \brief Generates noise sample of given channel
+ * \param index AWG channel index
+ * \return noise sample in Q15, gaussian noise has full scale at 3 sigma
+ */
+INT16 AWGNoise(const UINT16 index)
+{
+  TAWGEntryContext* const contextPtr = &AWGChannelContext[index];
+  UINT32 random1 = 0, random2 = 0;
+  INT32 sum = 0;
+  
+  random1 = AWGXorShift(&contextPtr->noiseState);
+  
+  if (contextPtr->parameters[contextPtr->published].noiseType != AWG_NOISE_GAUSSIAN)
+  {
+    return (INT16)(random1 >> 16);
+  }
+  
+  /* mean of four uniforms is close enough to normal distribution */
+  random2 = AWGXorShift(&contextPtr->noiseState);
+  sum = (INT32)(INT16)(random1 >> 16) + (INT16)random1 + (INT16)(random2 >> 16) + (INT16)random2;
+  
+  /* mean has sigma of full scale / sqrt(12), bring it to full scale / 3 */
+  sum = ((sum >> 2) * AWG_NOISE_GAUSSIAN_SCALE) >> 15;
+  
+  if (sum > AWG_Q15_MAXIMUM)
+  {
+    sum = AWG_Q15_MAXIMUM;
+  }
+  else if (sum < AWG_Q15_MINIMUM)
+  {
+    sum = AWG_Q15_MINIMUM;
+  }
+  
+  return (INT16)sum;
 }
 
-//float AWGGenerateAWGN(void)
-//{
-  /* generates additive white gaussian noise samples with zero mean and a standard deviation of 1 */ 
-//  float cache1 = 0.0f;
-//  float cache2 = 0.0f;
-//  float result = 0.0f;
-//  INT16 p = 1;
-
-//  while( p > 0 )
-//  {
-//    cache2 = (rand() / (float)RAND_MAX); /*  rand() function generates an
-//                                             integer between 0 and  RAND_MAX,
-//                                             which is defined in stdlib.h.
-//                                          */
-
-//    if (cache2 == 0 )
-//    {
-      /* cache2 is >= (RAND_MAX / 2) */
-//      p = 1;
-//    }
-//    else
-//    {
-      /* cache2 is < (RAND_MAX / 2) */
-//      p = -1;
-//    }
-
-//  }
-
-//  cache1 = cosf((2.0f * _M_PI) * rand() / (float)RAND_MAX);
-//  result = sqrtf(-2.0 * logf( cache2 ) ) * cache1;
-
-//  return result;        // return the generated random sample to the caller  
-//}
+UINT32 AWGPhaseStep(const UINT32, const UINT16);
 
 void AWGUpdateContext(TAWGEntry* const, TAWGEntryContext* const);
 
+/**
+ * \fn UINT32 AWGMultiplyHigh(const UINT32 multiplicand, const UINT32 multiplier)
+ * \brief Multiplies two 32-bit numbers and keeps high 32 bits of the product
+ * \param multiplicand
+ * \param multiplier
+ * \return product divided by 2^32
+ */
+UINT32 AWGMultiplyHigh(const UINT32 multiplicand, const UINT32 multiplier)
+{
+  UINT32 high = 0, cross1 = 0, cross2 = 0, low = 0;
+  
+  /* four 16x16 multiplies, middle column carries into high word */
+  high = (multiplicand >> 16) * (multiplier >> 16);
+  cross1 = (multiplicand >> 16) * (multiplier & 0xFFFF);
+  cross2 = (multiplicand & 0xFFFF) * (multiplier >> 16);
+  low = (multiplicand & 0xFFFF) * (multiplier & 0xFFFF);
+  
+  return high + (cross1 >> 16) + (cross2 >> 16) + (((low >> 16) + (cross1 & 0xFFFF) + (cross2 & 0xFFFF)) >> 16);
+}
+
+/**
+ * \fn void AWGSweepStep(TAWGEntryContext* const contextPtr)
+ * \brief Moves tuning word of given context one sample along its sweep
+ * \param contextPtr
+ */
+void AWGSweepStep(TAWGEntryContext* const contextPtr)
+{
+  UINT32 change = 0;
+  UINT16 fraction = 0;
+  
+  if (contextPtr->sweepRemaining <= 1)
+  { /* land exactly on stop frequency */
+    contextPtr->phaseStep = contextPtr->sweepStop;
+    contextPtr->sweepProfile = AWG_SWEEP_OFF;
+    return;
+  }
+  
+  --contextPtr->sweepRemaining;
+  
+  if (contextPtr->sweepProfile == AWG_SWEEP_LINEAR)
+  {
+    fraction = contextPtr->sweepFraction + contextPtr->sweepIncrementFraction;
+    change = contextPtr->sweepIncrement + (fraction < contextPtr->sweepFraction); /* carry */
+    contextPtr->sweepFraction = fraction;
+  }
+  else
+  {
+    change = AWGMultiplyHigh(contextPtr->phaseStep, contextPtr->sweepIncrement);
+  }
+  
+  if (contextPtr->isSweepRising)
+  {
+    contextPtr->phaseStep += change;
+  }
+  else
+  {
+    contextPtr->phaseStep -= change;
+  }
+}
+
+/**
+ * \fn void AWGPublishParameters(TAWGEntryContext* const contextPtr)
+ * \brief Makes staged parameter set of given context the published one
+ * \param contextPtr
+ */
+void AWGPublishParameters(TAWGEntryContext* const contextPtr)
+{
+  const TAWGParameters* const stagedPtr = &contextPtr->parameters[contextPtr->published ^ 1];
+  
+  /* a frequency other than sweep target ends the sweep */
+  if (contextPtr->sweepProfile != AWG_SWEEP_OFF && stagedPtr->frequency != contextPtr->sweepTarget)
+  {
+    contextPtr->sweepProfile = AWG_SWEEP_OFF;
+  }
+  
+  /* phase keeps running so a new frequency carries on without a jump */
+  if (contextPtr->sweepProfile == AWG_SWEEP_OFF)
+  {
+    contextPtr->phaseStep = stagedPtr->phaseStep;
+  }
+  
+  /* a single byte store, AWG routine sees either set complete */
+  contextPtr->published ^= 1;
+  contextPtr->isStaged = bFALSE;
+}
+
+/**
+ * \fn INT16 AWGRenderSample(const UINT16 index)
+ * \brief Calculates next sample of given channel and advances its phase
+ * \param index AWG channel index
+ * \return DAC value of the sample
+ */
+INT16 AWGRenderSample(const UINT16 index)
+{
+  TAWGEntryContext* const contextPtr = &AWGChannelContext[index];
+  TAWGSampleBuffer* const sampleBufferPtr = &AWGSampleBuffer[index];
+  const TAWGParameters* parametersPtr = (TAWGParameters*) 0x0000;
+  UINT16 phase = 0;
+  INT32 value = 0;
+  INT16 shape = 0;
+  
+  /* deferred set waits until phase has just wrapped, or forever stands still.
+     a set waits as well while the last change of sample period is still queued. */
+  if (contextPtr->isStaged && !sampleBufferPtr->isPeriodPending &&
+      (!contextPtr->parameters[contextPtr->published ^ 1].isDeferred || contextPtr->phase < contextPtr->phaseStep || !contextPtr->phaseStep))
+  {
+    AWGPublishParameters(contextPtr);
+  }
+  
+  parametersPtr = &contextPtr->parameters[contextPtr->published];
+  
+  /* samples already queued were rendered for the old period, AWG routine switches when it reaches this one */
+  if (parametersPtr->period != sampleBufferPtr->headPeriod)
+  {
+    sampleBufferPtr->headPeriod = parametersPtr->period;
+    sampleBufferPtr->periodIndex = sampleBufferPtr->head;
+    sampleBufferPtr->isPeriodPending = bTRUE; /* raised last, AWG routine sees index and period complete */
+  }
+  
+  /* top 16 bits of phase accumulator are good enough for every waveform */
+  phase = (UINT16)(contextPtr->phase >> 16);
+    	    
+  /* every waveform produces its shape in Q15 */
+  switch(parametersPtr->waveformType)
+  {
+    case AWG_WAVEFORM_SINE:
+      shape = AWGSine(phase);
+      break;
+    case AWG_WAVEFORM_SQUARE:
+      if (phase & 0x8000)
+      {
+        shape = AWG_Q15_MAXIMUM;
+      }
+      else
+      {
+        shape = -AWG_Q15_MAXIMUM;
+      }
+      break;
+    case AWG_WAVEFORM_TRIANGLE:
+      if (!(phase & 0x8000))
+      {
+        shape = (INT16)(AWG_Q15_MAXIMUM - 2 * (INT32)phase);
+      }
+      else
+      {
+        shape = (INT16)(2 * (INT32)(phase - 0x8000) - AWG_Q15_MAXIMUM);
+      }
+      break;
+    case AWG_WAVEFORM_SAWTOOTH:
+      shape = (INT16)(AWG_Q15_MAXIMUM - (INT32)phase);
+      break;
+    case AWG_WAVEFORM_NOISE:
+      shape = AWGNoise(index);
+      break;
+    case AWG_WAVEFORM_ARBITRARY:
+      shape = AWG_WaveSlot[parametersPtr->arbitrarySlot][phase >> (16 - AWG_ARBITRARY_WAVE_BITS)];
+      break;
+    case AWG_WAVEFORM_DC:
+    default:
+      break;
+  }
+  
+  /* one signed 16x16 multiply and a shift, offset is already part of bias */
+  value = parametersPtr->bias + ((((INT32)shape * parametersPtr->gain) + AWG_Q15_ROUND) >> 15);
+      
+  contextPtr->phase += contextPtr->phaseStep;
+  
+  if (contextPtr->sweepProfile != AWG_SWEEP_OFF)
+  {
+    AWGSweepStep(contextPtr);
+  }
+  
+  return AWGClampAnalog(value);
+}
+
+/**
+ * \fn void AWGSynthesizeArbitraryWave(const UINT8 slotNb)
+ * \brief Synthesizes next chunk of samples of given waveform slot from its staged phasors
+ * \param slotNb waveform slot number
+ */
+void AWGSynthesizeArbitraryWave(const UINT8 slotNb)
+{
+  TAWGPhasorSynthesis* const synthesisPtr = &AWGPhasorSynthesis[slotNb];
+  UINT16 phase[AWG_NB_HARMONICS];
+  UINT16 harmonicIndex = 0, sampleIndex = 0, lastSampleIndex = 0;
+  INT32 sample = 0;
+  
+  sampleIndex = synthesisPtr->sampleIndex;
+  lastSampleIndex = sampleIndex + AWG_PHASOR_SYNTHESIS_CHUNK;
+  
+  if (lastSampleIndex > AWG_ARBITRARY_WAVE_SIZE)
+  {
+    lastSampleIndex = AWG_ARBITRARY_WAVE_SIZE;
+  }
+  
+  /* phase of nth harmonic advances n times faster than fundamental */
+  for (harmonicIndex = 0; harmonicIndex < AWG_NB_HARMONICS; ++harmonicIndex)
+  {
+    phase[harmonicIndex] = synthesisPtr->phasor[harmonicIndex].phaseOffset + ((sampleIndex * (harmonicIndex + 1)) << (16 - AWG_ARBITRARY_WAVE_BITS));
+  }
+  
+  for (; sampleIndex < lastSampleIndex; ++sampleIndex)
+  {
+    sample = 0;
+    
+    for (harmonicIndex = 0; harmonicIndex < AWG_NB_HARMONICS; ++harmonicIndex)
+    {
+      if (synthesisPtr->phasor[harmonicIndex].gain)
+      {
+        sample -= ((INT32)AWGSine(phase[harmonicIndex]) * synthesisPtr->phasor[harmonicIndex].gain) >> 15;
+        phase[harmonicIndex] += (harmonicIndex + 1) << (16 - AWG_ARBITRARY_WAVE_BITS);
+      }
+    }
+    
+    /* summed phasors may go beyond full scale */
+    if (sample > AWG_Q15_MAXIMUM)
+    {
+      sample = AWG_Q15_MAXIMUM;
+    }
+    else if (sample < AWG_Q15_MINIMUM)
+    {
+      sample = AWG_Q15_MINIMUM;
+    }
+    
+    AWG_WaveSlot[slotNb][sampleIndex] = (INT16)sample;
+  }
+  
+  synthesisPtr->sampleIndex = sampleIndex;
+  
+  if (sampleIndex >= AWG_ARBITRARY_WAVE_SIZE)
+  {
+    synthesisPtr->isPending = bFALSE;
+  }
+}
+
 /**
  * \fn void AWGRoutine(TTimerChannel channelNb)
- * \brief Core of AWG implementation.
+ * \brief Core of AWG implementation. It only takes pre-rendered samples out of sample buffers.
  * \param channelNb timer channel number 
  */
 void AWGRoutine(TTimerChannel channelNb)
 {
   static TAWGChannel channelNumberLookupTable[NB_AWG_CHANNELS] = { AWG_Ch1,
-                                                                   AWG_Ch2 };
-  UINT16 index = 0xFFFF, sampleIndex = 0xFFFF;
-  INT16 analogValue = 0;
-  
-	Timer_ScheduleRoutine(channelNb, AWGRuntimeContext.routinePeriod); 
+                                                                   AWG_Ch2,
+                                                                   AWG_Ch3,
+                                                                   AWG_Ch4 };
+  UINT16 index = 0xFFFF;
+  UINT8 level = 0, dueMask = 0, outputMask = 0;
+  INT16 output[NB_AWG_CHANNELS];
+  BOOL renderRequired = bFALSE;
+  INT32 nextInterval = AWGRuntimeContext.maximumInterval;
       
+  /* serve every channel whose deadline has come, then sleep until the nearest one */
   for (index = 0; index < NB_AWG_CHANNELS; ++index) 
   {
-    if (AWG_Channel[index].isEnabled)
+    if (AWGChannelContext[index].isRunning)
     {
+      AWGChannelContext[index].countdown -= AWGRuntimeContext.routinePeriod;
+      
+      if (AWGChannelContext[index].countdown < (INT32)AWGRuntimeContext.minimumInterval)
+      {
+        level = (UINT8)(AWGSampleBuffer[index].head - AWGSampleBuffer[index].tail);
+        
+        /* period changes with the first sample rendered for it, never under samples rendered for the old one */
+        if (level && AWGSampleBuffer[index].isPeriodPending && AWGSampleBuffer[index].tail == AWGSampleBuffer[index].periodIndex)
+        {
+          AWGChannelContext[index].period = AWGSampleBuffer[index].headPeriod;
+          AWGSampleBuffer[index].isPeriodPending = bFALSE;
+        }
+        
+        AWGChannelContext[index].countdown += AWGChannelContext[index].period;
+        dueMask |= (UINT8)(1 << index);
+      
+        if (level)
+        {
+          output[index] = AWGSampleBuffer[index].sample[AWGSampleBuffer[index].tail & AWG_SAMPLE_BUFFER_MASK];
+          outputMask |= (UINT8)(1 << index);
+          ++AWGSampleBuffer[index].tail;
+          --level;
+        }
+        else
+        {
+          /* render thread fell behind, hold last output */
+          ++AWGSampleBuffer[index].underrunCount;
+        }
+      
+        if (level <= AWG_SAMPLE_BUFFER_LOW_WATER)
+        {
+          renderRequired = bTRUE;
+        }
+      }
+      
+      if (AWGChannelContext[index].countdown < nextInterval)
+      {
+        nextInterval = AWGChannelContext[index].countdown;
+      }
+    }
+  }
+  
+  /* channels due together are loaded first and change output at the same instant */
+  if (outputMask)
+  {
+    /* a sample SPI queue had no room for is held like an underrun */
+    outputMask &= (UINT8)~Analog_PutAll(outputMask, output);
     
-    	if (AWGChannelContext[index].time >= AWGChannelContext[index].frequencyPeriod)
-    	{
-    		AWGChannelContext[index].time = AWGChannelContext[index].time % AWGChannelContext[index].frequencyPeriod;
-    	}
-    	    
-		  switch(AWGChannelContext[index].waveformType)
-  		{
-    		case AWG_WAVEFORM_SINE:
-      	  
-      	  sampleIndex = (UINT16)((AWG_SINE_WAVE_SIZE * (AWGChannelContext[index].time / 10)) / (AWGChannelContext[index].frequencyPeriod / 10));
-      		
-      		sampleIndex = sampleIndex % AWG_SINE_WAVE_SIZE;
-				
-					AWGChannelContext[index].voltage = AWG_SINEWAVE[sampleIndex] / AWGChannelContext[index].voltageScale;
-
-      		analogValue = DAC_ZERO_VOLTAGE + AWGChannelContext[index].voltage;      		
-      		      		
-      		break;
-    		case AWG_WAVEFORM_SQUARE:
-      		if (AWGChannelContext[index].time > AWGChannelContext[index].halfFrequencyPeriod)
-      		{
-      			analogValue = DAC_ZERO_VOLTAGE + AWGChannelContext[index].amplitude;
-      		}
-      		else
-      		{
-      			analogValue = DAC_ZERO_VOLTAGE - AWGChannelContext[index].amplitude;
-      		}
-      		break;
-    		case AWG_WAVEFORM_TRIANGLE:
-					AWGChannelContext[index].voltage = (UINT16)((AWGChannelContext[index].amplitude * 4 * (AWGChannelContext[index].time / 10)) / (AWGChannelContext[index].frequencyPeriod / 10));
-					
-      		if (AWGChannelContext[index].time < AWGChannelContext[index].halfFrequencyPeriod)
-      		{
-      			analogValue = DAC_ZERO_VOLTAGE + (AWGChannelContext[index].amplitude - AWGChannelContext[index].voltage);
-      		}
-      		else
-      		{
-      			analogValue = DAC_ZERO_VOLTAGE + (AWGChannelContext[index].voltage - AWGChannelContext[index].amplitude * 3);
-      		}
-      		break;
-    		case AWG_WAVEFORM_SAWTOOTH:
-      		
-      		if (AWGChannelContext[index].time == 0)
-      		{
-      		  /* hotfix: resolve that end frequency period peak */
-        		analogValue = DAC_ZERO_VOLTAGE - AWGChannelContext[index].amplitude;
-        		
-        		analogValue -= AWG_Channel[index].offset;
-        		
-        		AWGOutAnalog(outputChannelNumberLookupTable[index], analogValue);
-      		  
-      		  AWGChannelContext[index].voltage = 0;      		  
-      		  
-      		}
-      		else
-      		{      		  
-      		  AWGChannelContext[index].voltage = (UINT16)((AWGChannelContext[index].amplitude * 2 * (AWGChannelContext[index].time / 10)) / (AWGChannelContext[index].frequencyPeriod / 10));
-      		}
-      		      		      		
-      		analogValue = DAC_ZERO_VOLTAGE + AWGChannelContext[index].amplitude - AWGChannelContext[index].voltage;
-      		
-      		break;
-    		case AWG_WAVEFORM_NOISE:
-    		  
-    		  analogValue = DAC_ZERO_VOLTAGE + AWGChannelContext[index].amplitude - (rand() % (AWGChannelContext[index].amplitude * 2));
-    		  //analogValue = DAC_ZERO_VOLTAGE + AWGChannelContext[index].amplitude - (INT16)(AWGGenerateAWGN() * AWGChannelContext[index].amplitude);
-    		  //analogValue = DAC_ZERO_VOLTAGE + (INT16)(AWGGenerateAWGN() * AWGChannelContext[index].amplitude);
-      		break;
-    		case AWG_WAVEFORM_ARBITRARY:
-      	  sampleIndex = (UINT16)((AWG_ARBITRARY_WAVE_SIZE * (AWGChannelContext[index].time / 10)) / (AWGChannelContext[index].frequencyPeriod / 10));
-      		
-      		sampleIndex = sampleIndex % AWG_ARBITRARY_WAVE_SIZE;
-				
-					//AWGChannelContext[index].voltage = (UINT16)(AWG_ARBITRARY_WAVE[sampleIndex] / AWGChannelContext[index].voltageScale);
-          AWGChannelContext[index].voltage = (UINT16)(AWG_Channel[index].arbitraryWave[sampleIndex] / AWGChannelContext[index].voltageScale);
-
-      		analogValue = DAC_ZERO_VOLTAGE + AWGChannelContext[index].voltage;
-      		break;
-    		case AWG_WAVEFORM_DC:
-    		default:
-      		break;
-  		}
-  		
-  		analogValue -= AWG_Channel[index].offset;
-  		
-  		AWGOutAnalog(outputChannelNumberLookupTable[index], analogValue);
+    for (index = 0; index < NB_AWG_CHANNELS; ++index)
+    {
+      if (outputMask & (1 << index))
+      {
+        ++AWGSampleBuffer[index].underrunCount;
+      }
+    }
+  }
+  
+  if (channelPostProcessRoutinePtr)
+  {
+    for (index = 0; index < NB_AWG_CHANNELS; ++index)
+    {
+      if (dueMask & (1 << index))
+      {
+        channelPostProcessRoutinePtr(channelNumberLookupTable[index]);
+      }
+    }
+  }
+  
+  /* a channel with period shorter than minimum interval still can not make dispatcher spin */
+  if (nextInterval < (INT32)AWGRuntimeContext.minimumInterval)
+  {
+    nextInterval = AWGRuntimeContext.minimumInterval;
+  }
+  
+  AWGRuntimeContext.routinePeriod = (UINT16)nextInterval;
+	Timer_ScheduleRoutine(channelNb, AWGRuntimeContext.routinePeriod); 
+  
+  /* wake up render thread only once until it starts filling */
+  if ((renderRequired || AWGSynthesisPending) && !AWGRenderPending && AWGRenderSemaphorePtr)
+  {
+    AWGRenderPending = bTRUE;
+    UNUSED(OS_SemaphoreSignal(AWGRenderSemaphorePtr));
+  }
+}
+
+/**
+ * \fn void AWG_RenderRoutine(void* dataPtr)
+ * \brief Keeps sample buffers of running AWG channels filled
+ * \param dataPtr not used
+ */
+void AWG_RenderRoutine(void* dataPtr)
+{
+  UINT16 index = 0xFFFF;
+  UINT8 slotIndex = 0;
+  
+  UNUSED(dataPtr);
+  
+  /* semaphore can only be created after OS has been initialized */
+  AWGRenderSemaphorePtr = OS_SemaphoreCreate(0);
+  
+  for (;;)
+  {
+    UNUSED(OS_SemaphoreWait(AWGRenderSemaphorePtr, 0));
+    AWGRenderPending = bFALSE;
+    
+    for (index = 0; index < NB_AWG_CHANNELS; ++index)
+    {
+      while (AWGChannelContext[index].isRunning && (UINT8)(AWGSampleBuffer[index].head - AWGSampleBuffer[index].tail) < AWG_SAMPLE_BUFFER_SIZE)
+      {
+        AWGSampleBuffer[index].sample[AWGSampleBuffer[index].head & AWG_SAMPLE_BUFFER_MASK] = AWGRenderSample(index);
+        ++AWGSampleBuffer[index].head;
+      }
+    }
+    
+    /* staged phasors are synthesized a chunk at a time so routine thread keeps running */
+    if (AWGSynthesisPending)
+    {
+      AWGSynthesisPending = bFALSE;
       
-			AWGChannelContext[index].time += AWGChannelContext[index].timeStep;
-			
-	  	if (channelPostProcessRoutinePtr)
-  		{
-    		channelPostProcessRoutinePtr(channelNumberLookupTable[index]);
-  		} 
-  		   		
+      for (slotIndex = 0; slotIndex < AWG_NB_WAVE_SLOTS; ++slotIndex)
+      {
+        if (AWGPhasorSynthesis[slotIndex].isPending)
+        {
+          AWGSynthesizeArbitraryWave(slotIndex);
+          AWGSynthesisPending |= AWGPhasorSynthesis[slotIndex].isPending;
+        }
+      }
     }
   }
-        
-};
+}
 
 /**
- * \fn void AWGUpdateContext(TAWGEntry* const entryPtr, TAWGEntryContext* const contextPtr)
- * \brief Updates given context base on given entry
- * \param entryPtr
- * \param contextPtr
+ * \fn UINT32 AWGPhaseStep(const UINT32 frequency, const UINT16 samplePeriod)
+ * \brief Calculates phase accumulator tuning word of given frequency
+ * \param frequency frequency in 0.1hz unit
+ * \param samplePeriod sample period in microseconds
+ * \return phase increment per sample
  */
-void AWGUpdateContext(TAWGEntry* const entryPtr, TAWGEntryContext* const contextPtr)
+UINT32 AWGPhaseStep(const UINT32 frequency, const UINT16 samplePeriod)
 {
-  UINT32 frequency = 0;
+  UINT32 product = 0, remainder = 0, step = 0;
+  
+  /* step = frequency * samplePeriod * 2^32 / 10^7 = (frequency * samplePeriod) * 2^25 / 78125 */
+  product = frequency * samplePeriod;
+  
+  /* long division in pieces to keep intermediate results within 32 bits */
+  step = (product / AWG_PHASE_STEP_DIVISOR) << 25;
+  remainder = (product % AWG_PHASE_STEP_DIVISOR) << 12;
+  step += (remainder / AWG_PHASE_STEP_DIVISOR) << 13;
+  remainder = (remainder % AWG_PHASE_STEP_DIVISOR) << 13;
+  step += remainder / AWG_PHASE_STEP_DIVISOR;
+  
+  return step;
+}
 
-  if (entryPtr && contextPtr)
+/**
+ * \fn BOOL AWGAdmit(const UINT16 index, const UINT16 samplePeriod)
+ * \brief Checks if running channels together with given channel at given sample period fit into CPU budget
+ * \param index AWG channel index
+ * \param samplePeriod sample period of given channel in microseconds
+ * \return TRUE if CPU budget allows it
+ */
+BOOL AWGAdmit(const UINT16 index, const UINT16 samplePeriod)
+{
+  UINT16 channelIndex = 0;
+  UINT32 load = 0;
+  
+  /* load in 1/1000 of CPU time */
+  for (channelIndex = 0; channelIndex < NB_AWG_CHANNELS; ++channelIndex)
   {
+    if (channelIndex == index)
+    {
+      load += (UINT32)AWG_SAMPLE_COST * 1000 / samplePeriod;
+    }
+    else if (AWGChannelContext[channelIndex].isRunning)
+    {
+      load += (UINT32)AWG_SAMPLE_COST * 1000 / AWG_Channel[channelIndex].samplePeriod;
+    }
+  }
+  
+  return load <= AWG_CPU_BUDGET;
+}
+
+/**
+ * \fn UINT32 AWGDecodeFrequency(const UINT16 encodedFrequency)
+ * \brief Converts ModCon frequency to 0.1hz unit
+ * \param encodedFrequency hertz in high byte and fraction of 256 in low byte
+ * \return frequency in 0.1hz unit
+ */
+UINT32 AWGDecodeFrequency(const UINT16 encodedFrequency)
+{
+  UINT32 frequency = 0;
   
-	  frequency = entryPtr->frequency % 256; /* XX.F*/
+	  frequency = encodedFrequency % 256; /* XX.F*/
 
   	switch(frequency)
   	{
@@ -518,34 +802,57 @@ void AWGUpdateContext(TAWGEntry* const entryPtr, TAWGEntryContext* const context
       	break;
   	};
   
-  	frequency += (entryPtr->frequency / 256) * 10;
-    
-    frequency = MATH_1_MEGA * 10 / frequency; /* in 1us unit */
+  	frequency += (encodedFrequency / 256) * 10;
+  
+  return frequency;
+}
+
+/**
+ * \fn void AWGUpdateContext(TAWGEntry* const entryPtr, TAWGEntryContext* const contextPtr)
+ * \brief Stages parameter set of given context base on given entry. Render thread publishes it.
+ * \param entryPtr
+ * \param contextPtr
+ */
+void AWGUpdateContext(TAWGEntry* const entryPtr, TAWGEntryContext* const contextPtr)
+{
+  TAWGParameters* stagedPtr = (TAWGParameters*) 0x0000;
+
+  if (entryPtr && contextPtr)
+  {
+    /* render thread leaves staged set alone until it is complete again */
+    contextPtr->isStaged = bFALSE;
+    stagedPtr = &contextPtr->parameters[contextPtr->published ^ 1];
+  
+    stagedPtr->frequency = entryPtr->frequency;
+    stagedPtr->phaseStep = AWGPhaseStep(AWGDecodeFrequency(entryPtr->frequency), entryPtr->samplePeriod);
+    stagedPtr->period = (UINT32)AWGRuntimeContext.scale * entryPtr->samplePeriod;
+   
+    stagedPtr->waveformType = entryPtr->waveformType;
+    stagedPtr->noiseType = entryPtr->noiseType;
+    stagedPtr->isDeferred = entryPtr->isUpdateDeferred;
     
-    if (contextPtr->frequencyPeriod != frequency)
+    if (entryPtr->arbitrarySlot < AWG_NB_WAVE_SLOTS)
     {
-    	contextPtr->time = 0;
+      stagedPtr->arbitrarySlot = entryPtr->arbitrarySlot;
+    }
+    else
+    {
+      stagedPtr->arbitrarySlot = contextPtr->parameters[contextPtr->published].arbitrarySlot;
     }
     
-    contextPtr->frequencyPeriod = frequency;
-    
-    contextPtr->halfFrequencyPeriod = contextPtr->frequencyPeriod / 2;
-    contextPtr->timeStep = AWG_ANALOG_OUTPUT_SAMPLING_RATE;
-   
-    contextPtr->waveformType = entryPtr->waveformType;
-    contextPtr->amplitude = entryPtr->amplitude;
-    contextPtr->offset = entryPtr->offset;
-
-    /* make sure it is not divided by zero */
-    if (contextPtr->amplitude > 0)
-    {      
-      contextPtr->voltageScale = 20480 / contextPtr->amplitude; /* use 20480 to increase accuracy */
+    /* keep gain within 16 bits so a sample costs one signed 16x16 multiply */
+    if (entryPtr->amplitude > AWG_Q15_MAXIMUM)
+    {
+      stagedPtr->gain = AWG_Q15_MAXIMUM;
     }
     else
     {
-      contextPtr->voltageScale = 0;
+      stagedPtr->gain = (INT16)entryPtr->amplitude;
     }
-            
+    
+    stagedPtr->bias = DAC_ZERO_VOLTAGE - entryPtr->offset;
+    
+    contextPtr->isStaged = bTRUE;
   }  
 }
 
@@ -584,14 +891,17 @@ void AWG_Update(TAWGChannel channelNb)
 }
 
 /**
- * \fn void AWG_Enable(TAWGChannel channelNb, BOOL enable)
+ * \fn BOOL AWG_Enable(TAWGChannel channelNb, BOOL enable)
  * \brief Enables/Disables given AWG channel
  * \param channelNb AWG channel number
  * \param enable TRUE if channel should be enable or FALSE otherwise
+ * \return FALSE if channel could not be enabled within CPU budget, or its output could not be zeroed as SPI queue was full
  */
-void AWG_Enable(TAWGChannel channelNb, BOOL enable)
+BOOL AWG_Enable(TAWGChannel channelNb, BOOL enable)
 {
   UINT16 index = 0xFFFF;
+  UINT8 savedCCR;
+  BOOL isZeroed = bTRUE;
   
   switch(channelNb)
   {
@@ -608,20 +918,246 @@ void AWG_Enable(TAWGChannel channelNb, BOOL enable)
       index = 3;
       break;      
     default:
-      return;
+      return bFALSE;
       break;
   }
   
+  if (AWG_Channel[index].isEnabled && enable && !AWGAdmit(index, AWG_Channel[index].samplePeriod))
+  {
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_AWG_BUDGET);
+#endif
+    return bFALSE;
+  }
+  
+  EnterCritical();
+  
+  /* drop samples rendered for previous settings, a period change queued with them goes too */
+  AWGSampleBuffer[index].tail = AWGSampleBuffer[index].head;
+  AWGSampleBuffer[index].isPeriodPending = bFALSE;
+  
   if (AWG_Channel[index].isEnabled && enable)
   {    
-    AWGUpdateContext(&AWG_Channel[index], &AWGChannelContext[index]);  
+    /* nothing renders a stopped channel, so settings are published straight away */
+    AWGUpdateContext(&AWG_Channel[index], &AWGChannelContext[index]);
+    AWGPublishParameters(&AWGChannelContext[index]);
+    AWGChannelContext[index].period = AWGChannelContext[index].parameters[AWGChannelContext[index].published].period;
+    AWGSampleBuffer[index].headPeriod = AWGChannelContext[index].period;
+    AWGChannelContext[index].countdown = AWGChannelContext[index].period;
     AWGChannelContext[index].isRunning = bTRUE;  
   }
   else
   {
     AWGChannelContext[index].isRunning = bFALSE;
-    Analog_Put(outputChannelNumberLookupTable[index], DAC_ZERO_VOLTAGE);  
+    isZeroed = Analog_Put(outputChannelNumberLookupTable[index], DAC_ZERO_VOLTAGE);  
+  }
+  
+  ExitCritical();
+  
+  if (AWGChannelContext[index].isRunning && AWGRenderSemaphorePtr)
+  {
+    UNUSED(OS_SemaphoreSignal(AWGRenderSemaphorePtr));
+  }
+  
+  return isZeroed;
+}
+
+/**
+ * \fn BOOL AWG_SetSamplePeriod(TAWGChannel channelNb, UINT16 samplePeriod)
+ * \brief Sets sample period of given AWG channel if CPU budget allows it
+ * \param channelNb AWG channel number
+ * \param samplePeriod sample period in microseconds
+ * \return TRUE if sample period was accepted
+ */
+BOOL AWG_SetSamplePeriod(TAWGChannel channelNb, UINT16 samplePeriod)
+{
+  UINT16 index = 0xFFFF;
+  
+  switch(channelNb)
+  {
+    case AWG_Ch1:
+      index = 0;
+      break;
+    case AWG_Ch2:
+      index = 1;
+      break;
+    case AWG_Ch3:
+      index = 2;
+      break;
+    case AWG_Ch4:
+      index = 3;
+      break;      
+    default:
+      return bFALSE;
+      break;
+  }
+  
+  if (samplePeriod == 0 || (AWGChannelContext[index].isRunning && !AWGAdmit(index, samplePeriod)))
+  {
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_AWG_BUDGET);
+#endif
+    return bFALSE;
+  }
+  
+  AWG_Channel[index].samplePeriod = samplePeriod;
+  AWG_Update(channelNb);
+  
+  return bTRUE;
+}
+
+/**
+ * \fn BOOL AWG_Sweep(TAWGChannel channelNb, TAWGSweepProfile profile, UINT16 startFrequency, UINT16 stopFrequency, UINT16 duration)
+ * \brief Sweeps frequency of given AWG channel without breaking its phase
+ * \param channelNb AWG channel number
+ * \param profile sweep profile, AWG_SWEEP_OFF stops a running sweep at its current frequency
+ * \param startFrequency frequency at the beginning, same format as TAWGEntry.frequency
+ * \param stopFrequency frequency at the end, same format as TAWGEntry.frequency
+ * \param duration sweep duration in milliseconds
+ * \return TRUE if sweep was started
+ */
+BOOL AWG_Sweep(TAWGChannel channelNb, TAWGSweepProfile profile, UINT16 startFrequency, UINT16 stopFrequency, UINT16 duration)
+{
+  TAWGEntryContext* contextPtr = (TAWGEntryContext*) 0x0000;
+  UINT16 index = 0xFFFF;
+  UINT32 startStep = 0, stopStep = 0, difference = 0, remainder = 0, nbSamples = 0;
+  UINT32 increment = 0;
+  UINT16 incrementFraction = 0;
+  float exponent = 0.0f, ratio = 0.0f;
+  UINT8 savedCCR;
+  
+  switch(channelNb)
+  {
+    case AWG_Ch1:
+      index = 0;
+      break;
+    case AWG_Ch2:
+      index = 1;
+      break;
+    case AWG_Ch3:
+      index = 2;
+      break;
+    case AWG_Ch4:
+      index = 3;
+      break;      
+    default:
+      return bFALSE;
+      break;
+  }
+  
+  contextPtr = &AWGChannelContext[index];
+  
+  if (profile == AWG_SWEEP_OFF)
+  {
+    EnterCritical();
+    contextPtr->sweepProfile = AWG_SWEEP_OFF;
+    ExitCritical();
+    return bTRUE;
+  }
+  
+  startStep = AWGPhaseStep(AWGDecodeFrequency(startFrequency), AWG_Channel[index].samplePeriod);
+  stopStep = AWGPhaseStep(AWGDecodeFrequency(stopFrequency), AWG_Channel[index].samplePeriod);
+  nbSamples = (UINT32)duration * 1000 / AWG_Channel[index].samplePeriod;
+  
+  if (profile == AWG_SWEEP_LOGARITHMIC && (startStep == 0 || stopStep == 0))
+  {
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_INVALID_ARGUMENT);
+#endif
+    return bFALSE;
+  }
+  
+  /* every division happens here, once per sweep */
+  if (nbSamples > 1)
+  {
+    if (profile == AWG_SWEEP_LINEAR)
+    {
+      difference = (stopStep > startStep) ? (stopStep - startStep) : (startStep - stopStep);
+      
+      /* extended precision increment, two long division steps of 8 bits for the fraction */
+      increment = difference / nbSamples;
+      remainder = (difference % nbSamples) << 8;
+      incrementFraction = (UINT16)((remainder / nbSamples) << 8);
+      remainder = (remainder % nbSamples) << 8;
+      incrementFraction |= (UINT16)(remainder / nbSamples);
+    }
+    else
+    {
+      /* tuning word is multiplied by (1 + increment) every sample, or by (1 - increment) when falling */
+      exponent = logf((float)stopStep / (float)startStep) / (float)nbSamples;
+      
+      if (exponent > 0.0f)
+      {
+        ratio = (exponent < 0.01f) ? exponent * (1.0f + exponent * (0.5f + exponent / 6.0f)) : expf(exponent) - 1.0f;
+      }
+      else
+      {
+        ratio = (exponent > -0.01f) ? -exponent * (1.0f + exponent * (0.5f + exponent / 6.0f)) : 1.0f - expf(exponent);
+      }
+      
+      if (ratio < 1.0f)
+      {
+        increment = (UINT32)(ratio * 4294967296.0f);
+      }
+      else
+      { /* too steep to sweep, jump straight to stop frequency */
+        nbSamples = 0;
+      }
+    }
+  }
+  
+  EnterCritical();
+  AWG_Channel[index].frequency = stopFrequency;
+  contextPtr->parameters[contextPtr->published ^ 1].frequency = stopFrequency; /* a pending staged set must not end the sweep */
+  contextPtr->phaseStep = startStep;
+  contextPtr->isSweepRising = (stopStep > startStep);
+  contextPtr->sweepTarget = stopFrequency;
+  contextPtr->sweepRemaining = nbSamples;
+  contextPtr->sweepStop = stopStep;
+  contextPtr->sweepIncrement = increment;
+  contextPtr->sweepIncrementFraction = incrementFraction;
+  contextPtr->sweepFraction = 0;
+  contextPtr->sweepProfile = profile;
+  ExitCritical();
+  
+  return bTRUE;
+}
+
+/**
+ * \fn UINT16 AWG_GetUnderrunCount(TAWGChannel channelNb)
+ * \brief Gets number of samples missed since sample buffer of given AWG channel was empty or SPI queue had no room for them
+ * \param channelNb AWG channel number
+ * \return underrun count
+ */
+UINT16 AWG_GetUnderrunCount(TAWGChannel channelNb)
+{
+  UINT16 index = 0xFFFF, count = 0;
+  UINT8 savedCCR;
+  
+  switch(channelNb)
+  {
+    case AWG_Ch1:
+      index = 0;
+      break;
+    case AWG_Ch2:
+      index = 1;
+      break;
+    case AWG_Ch3:
+      index = 2;
+      break;
+    case AWG_Ch4:
+      index = 3;
+      break;      
+    default:
+      return 0;
+      break;
   }
+  
+  EnterCritical();
+  count = AWGSampleBuffer[index].underrunCount;
+  ExitCritical();
+  
+  return count;
 }
 
 /**
@@ -641,21 +1177,34 @@ void AWG_Setup(const UINT32 busClk)
                            &AWGRoutine              /* routine          */
                          };
   UINT16 index = 0xFF;
+  UINT8 slotIndex = 0;
 
   AWGRuntimeContext.busClk = busClk;
   AWGRuntimeContext.scale = AWGRuntimeContext.busClk / MATH_1_MEGA;
   AWGRuntimeContext.routinePeriod = (UINT16)(AWGRuntimeContext.scale * AWG_ANALOG_OUTPUT_SAMPLING_RATE);
+  AWGRuntimeContext.minimumInterval = (UINT16)(AWGRuntimeContext.scale * AWG_DISPATCH_MINIMUM_INTERVAL);
+  AWGRuntimeContext.maximumInterval = (UINT16)(AWGRuntimeContext.scale * AWG_DISPATCH_MAXIMUM_INTERVAL);
     
   Timer_Init(TIMER_Ch5, &timerCh5);
 
   for (index = 0; index < NB_AWG_CHANNELS; ++index)
   {    
-    Analog_Put(outputChannelNumberLookupTable[index], DAC_ZERO_VOLTAGE);
+    /* SPI queue is empty at setup, so every channel fits */
+    UNUSED(Analog_Put(outputChannelNumberLookupTable[index], DAC_ZERO_VOLTAGE));
     /* hotfix for analog sampling issue */
     Analog_Output[index].OldValue.l = Analog_Output[index].Value.l;  
+    
+    AWG_Channel[index].samplePeriod = AWG_ANALOG_OUTPUT_SAMPLING_RATE;
+    AWGChannelContext[index].noiseState = AWG_NOISE_SEED + index; /* keep channels uncorrelated */
+    
+    /* every channel starts with a waveform slot of its own */
+    AWG_Channel[index].arbitrarySlot = (UINT8)(index % AWG_NB_WAVE_SLOTS);
   }  
 
-  AWG_ResetArbitraryWave();
+  for (slotIndex = 0; slotIndex < AWG_NB_WAVE_SLOTS; ++slotIndex)
+  {
+    AWG_ResetArbitraryWave(slotIndex);
+  }
 
   Timer_Set(TIMER_Ch5, AWGRuntimeContext.routinePeriod);
   Timer_Enable(TIMER_Ch5, bTRUE);  
@@ -681,51 +1230,75 @@ void AWG_DetachPostProcessRoutine(void)
 }
 
 /**
- * \fn void AWG_ApplyArbitraryPhasor(UINT8 harmonicNb, UINT16 magnitude, INT16 angle)
- * \brief Apply phasor to arbitrary wave sample buffer
+ * \fn void AWG_ApplyArbitraryPhasor(const UINT8 slotNb, UINT8 harmonicNb, UINT16 magnitude, INT16 angle)
+ * \brief Stages phasor of given waveform slot. Slot will be rebuilt from all its staged phasors in background.
+ * \param slotNb waveform slot number
  * \param harmonicNb it represents nth phasor harmonic
- * \param magnitude phasor magnitude
+ * \param magnitude phasor magnitude, 0 removes the harmonic
  * \param angle phasor angle 
  */
-void AWG_ApplyArbitraryPhasor(UINT8 harmonicNb, UINT16 magnitude, INT16 angle)
+void AWG_ApplyArbitraryPhasor(const UINT8 slotNb, UINT8 harmonicNb, UINT16 magnitude, INT16 angle)
 {
-  UINT16 channelIndex = 0;
-  UINT32 sineIndexOffset = 0, sineIndex = 0;
-  UINT32 sampleIndex = 0;
+  UINT16 phaseOffset = 0, gain = 0;
+  UINT8 savedCCR;
   
-  sineIndexOffset = (angle + 90) * 25 / 9;
+  if (slotNb >= AWG_NB_WAVE_SLOTS || harmonicNb < 1 || harmonicNb > AWG_NB_HARMONICS)
+  {
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_INVALID_ARGUMENT);
+#endif
+    return;
+  }
   
-  for (channelIndex = 0; channelIndex < NB_AWG_CHANNELS; ++channelIndex)
+  /* phasor angle is referenced to cosine, 65536 represents a full period */
+  phaseOffset = (UINT16)(((UINT32)(angle + 90) << 16) / 360);
+  
+  /* dividing by magnitude becomes a multiply by its reciprocal */
+  if (magnitude)
   {
-    if (AWG_Channel[channelIndex].isActive)
-    {      
-      for (sampleIndex = 0; sampleIndex < AWG_ARBITRARY_WAVE_SIZE; ++sampleIndex)
-      {
-        __RESET_WATCHDOG();
-        sineIndex = (sineIndexOffset + (sampleIndex * harmonicNb * AWG_SINE_WAVE_SIZE / AWG_ARBITRARY_WAVE_SIZE)) % AWG_SINE_WAVE_SIZE;   
-        AWG_Channel[channelIndex].arbitraryWave[sampleIndex] = AWG_Channel[channelIndex].arbitraryWave[sampleIndex] + (0 - AWG_SINEWAVE[sineIndex] / (INT16)magnitude);
-      } 
-    }
+    gain = (UINT16)(0x8000 / magnitude);
   }
+  
+  EnterCritical();
+  AWGPhasorSynthesis[slotNb].phasor[harmonicNb - 1].gain = gain;
+  AWGPhasorSynthesis[slotNb].phasor[harmonicNb - 1].phaseOffset = phaseOffset;
+      
+  /* start over so a burst of phasors ends up in a single rebuild */
+  AWGPhasorSynthesis[slotNb].sampleIndex = 0;
+  AWGPhasorSynthesis[slotNb].isPending = bTRUE;
+  AWGSynthesisPending = bTRUE;
+  ExitCritical();
 }
 
 /**
- * \fn void AWG_ResetArbitraryWave(void)
- * \brief Clear arbitrary wave buffer
+ * \fn void AWG_ResetArbitraryWave(const UINT8 slotNb)
+ * \brief Clear given waveform slot and its staged phasors
+ * \param slotNb waveform slot number
  */
-void AWG_ResetArbitraryWave(void)
+void AWG_ResetArbitraryWave(const UINT8 slotNb)
 {
-  UINT16 sampleIndex = 0, channelIndex = 0;
+  UINT16 sampleIndex = 0, harmonicIndex = 0;
+  UINT8 savedCCR;
   
-  for (channelIndex = 0; channelIndex < NB_AWG_CHANNELS; ++channelIndex)
+  if (slotNb >= AWG_NB_WAVE_SLOTS)
   {
-    if (AWG_Channel[channelIndex].isActive)
-    {
-      __RESET_WATCHDOG();      
-      for (sampleIndex = 0; sampleIndex < AWG_ARBITRARY_WAVE_SIZE; ++sampleIndex)
-      {
-        AWG_Channel[channelIndex].arbitraryWave[sampleIndex] = AWG_ARBITRARY_WAVE_INITIAL_VOLTAGE; /* match our scale */
-      }
-    }
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_INVALID_ARGUMENT);
+#endif
+    return;
   }
-}
\ No newline at end of file
+  
+  EnterCritical();
+  for (harmonicIndex = 0; harmonicIndex < AWG_NB_HARMONICS; ++harmonicIndex)
+  {
+    AWGPhasorSynthesis[slotNb].phasor[harmonicIndex].gain = 0;
+  }
+  AWGPhasorSynthesis[slotNb].isPending = bFALSE;
+  ExitCritical();
+      
+  __RESET_WATCHDOG();      
+  for (sampleIndex = 0; sampleIndex < AWG_ARBITRARY_WAVE_SIZE; ++sampleIndex)
+  {
+    AWG_WaveSlot[slotNb][sampleIndex] = AWG_ARBITRARY_WAVE_INITIAL_VOLTAGE; /* match our scale */
+  }
+}
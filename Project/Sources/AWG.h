@@ -11,9 +11,36 @@
 #error "AWG module depends on interrupt feature enabled."
 #endif
 
-#define NB_AWG_CHANNELS                 2
-#define AWG_ARBITRARY_WAVE_SIZE         256
-#define AWG_ANALOG_OUTPUT_SAMPLING_RATE 1000 /* 1000 micromseconds */
+#define NB_AWG_CHANNELS                 4
+#define AWG_ARBITRARY_WAVE_BITS         8
+#define AWG_ARBITRARY_WAVE_SIZE         (1 << AWG_ARBITRARY_WAVE_BITS)
+#define AWG_NB_HARMONICS                15
+#define AWG_NB_WAVE_SLOTS               4
+#define AWG_ANALOG_OUTPUT_SAMPLING_RATE 1000 /* default sample period, 1000 micromseconds */
+#define AWG_SAMPLE_BUFFER_BITS          5
+#define AWG_SAMPLE_BUFFER_SIZE          (1 << AWG_SAMPLE_BUFFER_BITS) /* must not exceed 128 */
+#define AWG_SAMPLE_BUFFER_MASK          (AWG_SAMPLE_BUFFER_SIZE - 1)
+#define AWG_SAMPLE_BUFFER_LOW_WATER     (AWG_SAMPLE_BUFFER_SIZE / 2)
+
+/**
+ * Share of CPU time all running AWG channels may take, in 1/1000
+ */
+#ifndef CONFIG_AWG_CPU_BUDGET
+#define AWG_CPU_BUDGET 500 /* fallback plan */
+#warning "AWG_CPU_BUDGET using fallback setting 500"
+#else
+#define AWG_CPU_BUDGET CONFIG_AWG_CPU_BUDGET
+#endif
+
+/**
+ * Estimated microseconds to render and output one sample
+ */
+#ifndef CONFIG_AWG_SAMPLE_COST
+#define AWG_SAMPLE_COST 60 /* fallback plan */
+#warning "AWG_SAMPLE_COST using fallback setting 60"
+#else
+#define AWG_SAMPLE_COST CONFIG_AWG_SAMPLE_COST
+#endif
 
 typedef enum
 {
@@ -26,6 +53,19 @@ typedef enum
   AWG_WAVEFORM_ARBITRARY
 } TAWGWaveformType;
 
+typedef enum
+{
+  AWG_NOISE_UNIFORM,
+  AWG_NOISE_GAUSSIAN
+} TAWGNoiseType;
+
+typedef enum
+{
+  AWG_SWEEP_OFF,
+  AWG_SWEEP_LINEAR,
+  AWG_SWEEP_LOGARITHMIC
+} TAWGSweepProfile;
+
 typedef enum
 {
   AWG_Ch1 = 0x00,
@@ -39,15 +79,19 @@ typedef void(*TAWGPostProcessRoutine)(TAWGChannel);
 typedef struct
 {
   TAWGWaveformType waveformType;
+  TAWGNoiseType noiseType;
         
   BOOL isActive;
   BOOL isEnabled;
   
   UINT16 frequency; /* 1 will be 0.1hz and 1000 will be 100hz */
+  UINT16 samplePeriod; /* in microseconds */
   UINT16 amplitude;
   INT16 offset;
   
-  INT32 arbitraryWave[AWG_ARBITRARY_WAVE_SIZE]; /* arbitrary wave buffer */
+  UINT8 arbitrarySlot; /* waveform slot played by arbitrary waveform */
+  
+  BOOL isUpdateDeferred; /* new settings take over at period boundary instead of next sample */
     
 } TAWGEntry;
 
@@ -57,9 +101,9 @@ typedef struct
 extern TAWGEntry AWG_Channel[NB_AWG_CHANNELS];
 
 /**
- * \brief arbitrary wave buffer
+ * \brief arbitrary waveform slots in Q15, shared by channels
  */
-//extern INT32 AWG_ARBITRARY_WAVE[AWG_ARBITRARY_WAVE_SIZE];
+extern INT16 AWG_WaveSlot[AWG_NB_WAVE_SLOTS][AWG_ARBITRARY_WAVE_SIZE];
 
 /**
  * \fn void AWG_Setup(const UINT32 busClk)
@@ -70,33 +114,73 @@ void AWG_Setup(const UINT32 busClk);
 
 /**
  * \fn void AWG_Update(TAWGChannel channelNb)
- * \brief Update runtime context of given AWG channel
+ * \brief Update runtime context of given AWG channel. Settings are staged without blocking interrupts
+ *        and take over at next rendered sample, or at period boundary if update is deferred.
  * \param channelNb AWG channel number
  */
 void AWG_Update(TAWGChannel channelNb);
 
 /**
- * \fn void AWG_Enable(TAWGChannel channelNb, BOOL enable)
+ * \fn BOOL AWG_Enable(TAWGChannel channelNb, BOOL enable)
  * \brief Enables/Disables given AWG channel
  * \param channelNb AWG channel number
  * \param enable TRUE if channel should be enable or FALSE otherwise
+ * \return FALSE if channel could not be enabled within CPU budget, or its output could not be zeroed as SPI queue was full
+ */
+BOOL AWG_Enable(TAWGChannel channelNb, BOOL enable);
+
+/**
+ * \fn BOOL AWG_SetSamplePeriod(TAWGChannel channelNb, UINT16 samplePeriod)
+ * \brief Sets sample period of given AWG channel if CPU budget allows it
+ * \param channelNb AWG channel number
+ * \param samplePeriod sample period in microseconds
+ * \return TRUE if sample period was accepted
+ */
+BOOL AWG_SetSamplePeriod(TAWGChannel channelNb, UINT16 samplePeriod);
+
+/**
+ * \fn BOOL AWG_Sweep(TAWGChannel channelNb, TAWGSweepProfile profile, UINT16 startFrequency, UINT16 stopFrequency, UINT16 duration)
+ * \brief Sweeps frequency of given AWG channel without breaking its phase
+ * \param channelNb AWG channel number
+ * \param profile sweep profile, AWG_SWEEP_OFF stops a running sweep at its current frequency
+ * \param startFrequency frequency at the beginning, same format as TAWGEntry.frequency
+ * \param stopFrequency frequency at the end, same format as TAWGEntry.frequency
+ * \param duration sweep duration in milliseconds
+ * \return TRUE if sweep was started
+ */
+BOOL AWG_Sweep(TAWGChannel channelNb, TAWGSweepProfile profile, UINT16 startFrequency, UINT16 stopFrequency, UINT16 duration);
+
+/**
+ * \fn UINT16 AWG_GetUnderrunCount(TAWGChannel channelNb)
+ * \brief Gets number of samples missed since sample buffer of given AWG channel was empty or SPI queue had no room for them
+ * \param channelNb AWG channel number
+ * \return underrun count
+ */
+UINT16 AWG_GetUnderrunCount(TAWGChannel channelNb);
+
+/**
+ * \fn void AWG_RenderRoutine(void* dataPtr)
+ * \brief Keeps sample buffers of running AWG channels filled. It runs as a thread.
+ * \param dataPtr not used
  */
-void AWG_Enable(TAWGChannel channelNb, BOOL enable);
+void AWG_RenderRoutine(void* dataPtr);
 
 /**
- * \fn void AWG_ApplyArbitraryPhasor(UINT8 harmonicNb, UINT16 magnitude, INT16 angle)
- * \brief Apply phasor to arbitrary wave sample buffer
+ * \fn void AWG_ApplyArbitraryPhasor(const UINT8 slotNb, UINT8 harmonicNb, UINT16 magnitude, INT16 angle)
+ * \brief Stages phasor of given waveform slot. Slot will be rebuilt from all its staged phasors in background.
+ * \param slotNb waveform slot number
  * \param harmonicNb it represents nth phasor harmonic
- * \param magnitude phasor magnitude
+ * \param magnitude phasor magnitude, 0 removes the harmonic
  * \param angle phasor angle 
  */
-void AWG_ApplyArbitraryPhasor(UINT8 harmonicNb, UINT16 magnitude, INT16 angle);
+void AWG_ApplyArbitraryPhasor(const UINT8 slotNb, UINT8 harmonicNb, UINT16 magnitude, INT16 angle);
 
 /**
- * \fn void AWG_ResetArbitraryWave(void)
- * \brief Clear arbitrary wave buffer
+ * \fn void AWG_ResetArbitraryWave(const UINT8 slotNb)
+ * \brief Clear given waveform slot and its staged phasors
+ * \param slotNb waveform slot number
  */
-void AWG_ResetArbitraryWave(void);
+void AWG_ResetArbitraryWave(const UINT8 slotNb);
 
 /**
  * \fn void AWG_AttachPostProcessRoutine(TAWGPostProcessRoutine routine)
@@ -7,20 +7,59 @@
 #include "FIFO.h"
 
 /**
- * \fn void FIFO_Init(TFIFO * const FIFO)
+ * \fn void FIFOPublish(TFIFO * const FIFO, const UINT16 nbBytes)
+ * \brief Makes given number of bytes just stored at the end visible, unless a reservation before them is still open
+ * \param FIFO a pointer to a FIFO struct
+ * \param nbBytes number of bytes
+ * \warning Interrupts must be masked
+ */
+void FIFOPublish(TFIFO * const FIFO, const UINT16 nbBytes)
+{
+  if (FIFO->NbReservations)
+  {
+    FIFO->NbPending += nbBytes;
+  }
+  else
+  {
+    FIFO->NbBytes += nbBytes;
+  }
+}
+
+/**
+ * \fn void FIFO_Init(TFIFO * const FIFO, UINT8 * const buffer, const UINT16 size)
  * \brief Initialize the FIFO.
  * \param FIFO a pointer to a FIFO struct to initialize
+ * \param buffer byte array serving as container
+ * \param size capacity of the buffer, it must be a power of two
  */
-void FIFO_Init(TFIFO * const FIFO) 
+void FIFO_Init(TFIFO * const FIFO, UINT8 * const buffer, const UINT16 size) 
 {
   UINT8 savedCCR;
-  if (FIFO) 
+  if (FIFO && buffer) 
   {
     /* ready given FIFO by setting zeros */
     EnterCritical();
     FIFO->Start = 0;
     FIFO->End   = 0;
     FIFO->NbBytes = 0;
+    FIFO->NbPending = 0;
+    FIFO->NbReservations = 0;
+    FIFO->Buffer = buffer;
+    
+    /* iterators wrap by mask, a FIFO without proper size stays full */
+    if (size && !(size & (size - 1)))
+    {
+      FIFO->Size = size;
+    }
+    else
+    {
+      FIFO->Size = 0;
+#ifndef NO_DEBUG
+      DEBUG(__LINE__, ERR_INVALID_ARGUMENT);
+#endif
+    }
+    
+    FIFO->Mask = FIFO->Size - 1;
     ExitCritical();
     return;
   }
@@ -42,16 +81,16 @@ BOOL FIFO_Put(TFIFO * const FIFO, const UINT8 data)
   UINT8 savedCCR;
   if (FIFO) 
   {
-    if (FIFO->NbBytes < FIFO_SIZE) 
+    EnterCritical();          
+    if (FIFO->NbBytes + FIFO->NbPending < FIFO->Size) 
     {
-      EnterCritical();          
-      FIFO->Buffer[FIFO->End++] = data;
-      if (FIFO->End >= FIFO_SIZE) /* once End reaches boundry, go back to zero */
-        FIFO->End = 0;            
-      FIFO->NbBytes++;
+      FIFO->Buffer[FIFO->End] = data;
+      FIFO->End = (FIFO->End + 1) & FIFO->Mask;
+      FIFOPublish(FIFO, 1);
       ExitCritical();
       return bTRUE;
     }
+    ExitCritical();
     return bFALSE;
   }
 #ifndef NO_DEBUG
@@ -76,9 +115,8 @@ BOOL FIFO_Get(TFIFO * const FIFO, UINT8 * const dataPtr)
     if (FIFO->NbBytes != 0) 
     {          
       EnterCritical();          
-      *dataPtr = FIFO->Buffer[FIFO->Start++];
-      if (FIFO->Start >= FIFO_SIZE) /* once Start reaches boundry, go back to zero */
-        FIFO->Start = 0;            
+      *dataPtr = FIFO->Buffer[FIFO->Start];
+      FIFO->Start = (FIFO->Start + 1) & FIFO->Mask;
       FIFO->NbBytes--;
       ExitCritical();          
       return bTRUE;
@@ -90,3 +128,239 @@ BOOL FIFO_Get(TFIFO * const FIFO, UINT8 * const dataPtr)
 #endif
   return bFALSE;
 }
+
+/**
+ * \fn BOOL FIFO_Reserve(TFIFO * const FIFO, const UINT16 nbBytes, TFIFOReservation * const reservationPtr)
+ * \brief Takes room for given number of bytes at the end of the FIFO. Nothing after it is visible until it is committed.
+ * \param FIFO a  pointer to a FIFO struct where data is to be stored
+ * \param nbBytes number of bytes to reserve
+ * \param reservationPtr a pointer to a reservation to fill in
+ * \return TRUE if there was room
+ * \warning Assumes that FIFO_Init has been called.
+ */
+BOOL FIFO_Reserve(TFIFO * const FIFO, const UINT16 nbBytes, TFIFOReservation * const reservationPtr)
+{
+  UINT8 savedCCR;
+  if (FIFO && reservationPtr) 
+  {
+    EnterCritical();
+    
+    if (FIFO->Size - FIFO->NbBytes - FIFO->NbPending < nbBytes || FIFO->NbReservations == 0xFF)
+    {
+      ExitCritical();
+      return bFALSE;
+    }
+    
+    reservationPtr->Start = FIFO->End;
+    reservationPtr->NbBytes = nbBytes;
+    
+    FIFO->End = (FIFO->End + nbBytes) & FIFO->Mask;
+    FIFO->NbPending += nbBytes;
+    ++FIFO->NbReservations;
+    
+    ExitCritical();
+    return bTRUE;
+  }
+#ifndef NO_DEBUG
+  DEBUG(__LINE__, ERR_INVALID_POINTER);
+#endif
+  return bFALSE;
+}
+
+/**
+ * \fn void FIFO_Write(TFIFO * const FIFO, const TFIFOReservation * const reservationPtr, const UINT16 offset, const UINT8 data)
+ * \brief Stores one byte into reserved room.
+ * \param FIFO a  pointer to a FIFO struct holding the reservation
+ * \param reservationPtr a pointer to the reservation
+ * \param offset position of the byte within the reservation
+ * \param data a byte of data to store
+ */
+void FIFO_Write(TFIFO * const FIFO, const TFIFOReservation * const reservationPtr, const UINT16 offset, const UINT8 data)
+{
+  /* reserved room belongs to its owner alone, no critical section */
+  if (FIFO && reservationPtr && offset < reservationPtr->NbBytes)
+  {
+    FIFO->Buffer[(reservationPtr->Start + offset) & FIFO->Mask] = data;
+    return;
+  }
+#ifndef NO_DEBUG
+  DEBUG(__LINE__, ERR_INVALID_ARGUMENT);
+#endif
+}
+
+/**
+ * \fn void FIFO_WriteBlock(TFIFO * const FIFO, const TFIFOReservation * const reservationPtr, const UINT16 offset, const UINT8 * const dataPtr, const UINT16 nbBytes)
+ * \brief Stores given bytes into reserved room.
+ * \param FIFO a  pointer to a FIFO struct holding the reservation
+ * \param reservationPtr a pointer to the reservation
+ * \param offset position of the first byte within the reservation
+ * \param dataPtr a pointer to bytes to store
+ * \param nbBytes number of bytes to store
+ */
+void FIFO_WriteBlock(TFIFO * const FIFO, const TFIFOReservation * const reservationPtr, const UINT16 offset, const UINT8 * const dataPtr, const UINT16 nbBytes)
+{
+  UINT16 index = 0, position = 0;
+  
+  /* reserved room belongs to its owner alone, no critical section */
+  if (FIFO && reservationPtr && dataPtr && offset <= reservationPtr->NbBytes && nbBytes <= reservationPtr->NbBytes - offset)
+  {
+    position = reservationPtr->Start + offset;
+    for (index = 0; index < nbBytes; ++index)
+    {
+      FIFO->Buffer[position & FIFO->Mask] = dataPtr[index];
+      ++position;
+    }
+    return;
+  }
+#ifndef NO_DEBUG
+  DEBUG(__LINE__, ERR_INVALID_ARGUMENT);
+#endif
+}
+
+/**
+ * \fn void FIFO_Commit(TFIFO * const FIFO, const TFIFOReservation * const reservationPtr)
+ * \brief Closes given reservation. Bytes become visible once every open reservation has been committed.
+ * \param FIFO a  pointer to a FIFO struct holding the reservation
+ * \param reservationPtr a pointer to the reservation
+ */
+void FIFO_Commit(TFIFO * const FIFO, const TFIFOReservation * const reservationPtr)
+{
+  UINT8 savedCCR;
+  if (FIFO && reservationPtr) 
+  {
+    EnterCritical();
+    
+    /* reservations are contiguous, so the last one to close releases them all in order */
+    if (FIFO->NbReservations && --FIFO->NbReservations == 0)
+    {
+      FIFO->NbBytes += FIFO->NbPending;
+      FIFO->NbPending = 0;
+    }
+    
+    ExitCritical();
+    return;
+  }
+#ifndef NO_DEBUG
+  DEBUG(__LINE__, ERR_INVALID_POINTER);
+#endif
+}
+
+/**
+ * \fn UINT16 FIFO_Free(const TFIFO * const FIFO)
+ * \brief Tells how many bytes the FIFO can still take
+ * \param FIFO a  pointer to a FIFO struct
+ * \return number of free bytes
+ */
+UINT16 FIFO_Free(const TFIFO * const FIFO)
+{
+  UINT8 savedCCR;
+  UINT16 nbBytes = 0;
+  if (FIFO) 
+  {
+    EnterCritical();
+    nbBytes = FIFO->Size - FIFO->NbBytes - FIFO->NbPending;
+    ExitCritical();
+    return nbBytes;
+  }
+#ifndef NO_DEBUG
+  DEBUG(__LINE__, ERR_INVALID_POINTER);
+#endif
+  return 0;
+}
+
+/**
+ * \fn void FIFO_InitSPSC(TSPSCFIFO * const FIFO, UINT8 * const buffer, const UINT16 size)
+ * \brief Initialize the single producer single consumer FIFO.
+ * \param FIFO a pointer to a FIFO struct to initialize
+ * \param buffer byte array serving as container
+ * \param size capacity of the buffer, it must be a power of two not larger than 32768
+ * \warning Neither producer nor consumer may run meanwhile.
+ */
+void FIFO_InitSPSC(TSPSCFIFO * const FIFO, UINT8 * const buffer, const UINT16 size)
+{
+  if (FIFO && buffer) 
+  {
+    FIFO->Head = 0;
+    FIFO->Tail = 0;
+    FIFO->Buffer = buffer;
+    
+    /* iterators are free running, so count must stay below 16-bit wrap */
+    if (size && size <= 0x8000 && !(size & (size - 1)))
+    {
+      FIFO->Size = size;
+    }
+    else
+    {
+      FIFO->Size = 0;
+#ifndef NO_DEBUG
+      DEBUG(__LINE__, ERR_INVALID_ARGUMENT);
+#endif
+    }
+    
+    FIFO->Mask = FIFO->Size - 1;
+    return;
+  }
+#ifndef NO_DEBUG
+  DEBUG(__LINE__, ERR_INVALID_POINTER);
+#endif
+}
+
+/**
+ * \fn BOOL FIFO_PutSPSC(TSPSCFIFO * const FIFO, const UINT8 data)
+ * \brief Enter one character into the FIFO. Only the producer may call it.
+ * \param FIFO a  pointer to a FIFO struct where data is to be stored
+ * \param data a byte of data to store in the FIFO buffer
+ * \return TRUE if data is properly saved
+ * \warning Assumes that FIFO_InitSPSC has been called.
+ */
+BOOL FIFO_PutSPSC(TSPSCFIFO * const FIFO, const UINT8 data)
+{
+  UINT16 head = 0;
+  if (FIFO) 
+  {
+    head = FIFO->Head;
+    
+    /* consumer can only make room meanwhile */
+    if ((UINT16)(head - FIFO->Tail) < FIFO->Size)
+    {
+      FIFO->Buffer[head & FIFO->Mask] = data;
+      FIFO->Head = head + 1; /* one 16-bit store publishes the byte */
+      return bTRUE;
+    }
+    return bFALSE;
+  }
+#ifndef NO_DEBUG
+  DEBUG(__LINE__, ERR_INVALID_POINTER);
+#endif
+  return bFALSE;
+}
+
+/**
+ * \fn BOOL FIFO_GetSPSC(TSPSCFIFO * const FIFO, UINT8 * const dataPtr)
+ * \brief Remove one character from the FIFO. Only the consumer may call it.
+ * \param FIFO a  pointer to a FIFO struct with data to be retrieved
+ * \param dataPtr a pointer to a memory location to place the retrieved byte
+ * \return TRUE if the operation was successful and the data is valid
+ * \warning Assumes that FIFO_InitSPSC has been called.
+ */
+BOOL FIFO_GetSPSC(TSPSCFIFO * const FIFO, UINT8 * const dataPtr)
+{
+  UINT16 tail = 0;
+  if (FIFO && dataPtr) 
+  {
+    tail = FIFO->Tail;
+    
+    /* producer can only add bytes meanwhile */
+    if (FIFO->Head != tail)
+    {
+      *dataPtr = FIFO->Buffer[tail & FIFO->Mask];
+      FIFO->Tail = tail + 1; /* one 16-bit store hands the slot back */
+      return bTRUE;
+    }
+    return bFALSE;
+  }
+#ifndef NO_DEBUG
+  DEBUG(__LINE__, ERR_INVALID_POINTER);
+#endif
+  return bFALSE;
+}
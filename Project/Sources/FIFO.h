@@ -9,32 +9,49 @@
 
 #include "global.h"
 
-/**
- * FIFO buffer capacity
- */
-#ifndef CONFIG_FIFO_SIZE
-#define FIFO_SIZE 256 /* fallback plan */
-#warning "FIFO_SIZE using fallback setting 256"
-#else
-#define FIFO_SIZE CONFIG_FIFO_SIZE
-#endif
-
 /**
  * \brief FIFO buffer structure
  */
 typedef struct
 {
-  UINT16 Start, End;        /* \brief boundary and iterator, it should be from 0 to FIFO_SIZE - 1. */
+  UINT16 Start, End;        /* \brief boundary and iterator, it should be from 0 to Size - 1. */
   UINT16 volatile NbBytes;  /* \brief count of bytes inside the buffer */
-  UINT8 Buffer[FIFO_SIZE];  /* \brief byte array serving as container */
+  UINT16 NbPending;         /* \brief count of bytes behind an open reservation, not visible yet */
+  UINT8 NbReservations;     /* \brief count of open reservations */
+  UINT16 Size;              /* \brief capacity of the buffer, power of two */
+  UINT16 Mask;              /* \brief Size - 1, wraps iterators */
+  UINT8 * Buffer;           /* \brief byte array serving as container, owned by user of the FIFO */
 } TFIFO;
 
 /**
- * \fn void FIFO_Init(TFIFO * const FIFO)
+ * \brief Room taken in FIFO buffer that is filled before it is committed
+ */
+typedef struct
+{
+  UINT16 Start;             /* \brief first reserved byte */
+  UINT16 NbBytes;           /* \brief count of reserved bytes */
+} TFIFOReservation;
+
+/**
+ * \brief FIFO buffer structure for exactly one producer and one consumer, it needs no critical section
+ */
+typedef struct
+{
+  UINT16 volatile Head;     /* \brief free running iterator, only producer writes it */
+  UINT16 volatile Tail;     /* \brief free running iterator, only consumer writes it */
+  UINT16 Size;              /* \brief capacity of the buffer, power of two */
+  UINT16 Mask;              /* \brief Size - 1, wraps iterators */
+  UINT8 * Buffer;           /* \brief byte array serving as container, owned by user of the FIFO */
+} TSPSCFIFO;
+
+/**
+ * \fn void FIFO_Init(TFIFO * const FIFO, UINT8 * const buffer, const UINT16 size)
  * \brief Initialize the FIFO.
  * \param FIFO a pointer to a FIFO struct to initialize
+ * \param buffer byte array serving as container
+ * \param size capacity of the buffer, it must be a power of two
  */
-void FIFO_Init(TFIFO * const FIFO);
+void FIFO_Init(TFIFO * const FIFO, UINT8 * const buffer, const UINT16 size);
 
 /**
  * \fn BOOL FIFO_Put(TFIFO * const FIFO, const UINT8 data)
@@ -56,4 +73,82 @@ BOOL FIFO_Put(TFIFO * const FIFO, const UINT8 data);
  */
 BOOL FIFO_Get(TFIFO * const FIFO, UINT8 * const dataPtr); 
 
-#endif
\ No newline at end of file
+/**
+ * \fn BOOL FIFO_Reserve(TFIFO * const FIFO, const UINT16 nbBytes, TFIFOReservation * const reservationPtr)
+ * \brief Takes room for given number of bytes at the end of the FIFO. Nothing after it is visible until it is committed.
+ * \param FIFO a  pointer to a FIFO struct where data is to be stored
+ * \param nbBytes number of bytes to reserve
+ * \param reservationPtr a pointer to a reservation to fill in
+ * \return TRUE if there was room
+ * \warning Assumes that FIFO_Init has been called.
+ */
+BOOL FIFO_Reserve(TFIFO * const FIFO, const UINT16 nbBytes, TFIFOReservation * const reservationPtr);
+
+/**
+ * \fn void FIFO_Write(TFIFO * const FIFO, const TFIFOReservation * const reservationPtr, const UINT16 offset, const UINT8 data)
+ * \brief Stores one byte into reserved room.
+ * \param FIFO a  pointer to a FIFO struct holding the reservation
+ * \param reservationPtr a pointer to the reservation
+ * \param offset position of the byte within the reservation
+ * \param data a byte of data to store
+ */
+void FIFO_Write(TFIFO * const FIFO, const TFIFOReservation * const reservationPtr, const UINT16 offset, const UINT8 data);
+
+/**
+ * \fn void FIFO_WriteBlock(TFIFO * const FIFO, const TFIFOReservation * const reservationPtr, const UINT16 offset, const UINT8 * const dataPtr, const UINT16 nbBytes)
+ * \brief Stores given bytes into reserved room.
+ * \param FIFO a  pointer to a FIFO struct holding the reservation
+ * \param reservationPtr a pointer to the reservation
+ * \param offset position of the first byte within the reservation
+ * \param dataPtr a pointer to bytes to store
+ * \param nbBytes number of bytes to store
+ */
+void FIFO_WriteBlock(TFIFO * const FIFO, const TFIFOReservation * const reservationPtr, const UINT16 offset, const UINT8 * const dataPtr, const UINT16 nbBytes);
+
+/**
+ * \fn void FIFO_Commit(TFIFO * const FIFO, const TFIFOReservation * const reservationPtr)
+ * \brief Closes given reservation. Bytes become visible once every open reservation has been committed.
+ * \param FIFO a  pointer to a FIFO struct holding the reservation
+ * \param reservationPtr a pointer to the reservation
+ */
+void FIFO_Commit(TFIFO * const FIFO, const TFIFOReservation * const reservationPtr);
+
+/**
+ * \fn UINT16 FIFO_Free(const TFIFO * const FIFO)
+ * \brief Tells how many bytes the FIFO can still take
+ * \param FIFO a  pointer to a FIFO struct
+ * \return number of free bytes
+ */
+UINT16 FIFO_Free(const TFIFO * const FIFO);
+
+/**
+ * \fn void FIFO_InitSPSC(TSPSCFIFO * const FIFO, UINT8 * const buffer, const UINT16 size)
+ * \brief Initialize the single producer single consumer FIFO.
+ * \param FIFO a pointer to a FIFO struct to initialize
+ * \param buffer byte array serving as container
+ * \param size capacity of the buffer, it must be a power of two not larger than 32768
+ * \warning Neither producer nor consumer may run meanwhile.
+ */
+void FIFO_InitSPSC(TSPSCFIFO * const FIFO, UINT8 * const buffer, const UINT16 size);
+
+/**
+ * \fn BOOL FIFO_PutSPSC(TSPSCFIFO * const FIFO, const UINT8 data)
+ * \brief Enter one character into the FIFO. Only the producer may call it.
+ * \param FIFO a  pointer to a FIFO struct where data is to be stored
+ * \param data a byte of data to store in the FIFO buffer
+ * \return TRUE if data is properly saved
+ * \warning Assumes that FIFO_InitSPSC has been called.
+ */
+BOOL FIFO_PutSPSC(TSPSCFIFO * const FIFO, const UINT8 data);
+
+/**
+ * \fn BOOL FIFO_GetSPSC(TSPSCFIFO * const FIFO, UINT8 * const dataPtr)
+ * \brief Remove one character from the FIFO. Only the consumer may call it.
+ * \param FIFO a  pointer to a FIFO struct with data to be retrieved
+ * \param dataPtr a pointer to a memory location to place the retrieved byte
+ * \return TRUE if the operation was successful and the data is valid
+ * \warning Assumes that FIFO_InitSPSC has been called.
+ */
+BOOL FIFO_GetSPSC(TSPSCFIFO * const FIFO, UINT8 * const dataPtr);
+
+#endif
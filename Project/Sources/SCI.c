@@ -5,36 +5,134 @@
  * \date 06-August-2014
  */
 #include "SCI.h"
-#include "FIFO.h"
-#ifndef NO_INTERRUPT
-#include "timer.h"
-#endif
 #include "OS.h"
 #include <mc9s12a512.h>
 
-static TFIFO RxFIFO, TxFIFO; /* no one can touch them except SCI_ calls */
+static TSPSCFIFO RxFIFO; /* receive ISR is its only producer and SCI_In calls or SCI_ResumeReceive its only consumer */
+static TFIFO TxFIFO, TxBulkFIFO; /* no one can touch them except SCI_ calls */
+static UINT8 RxFIFOBuffer[SCI_RX_FIFO_SIZE], TxFIFOBuffer[SCI_TX_FIFO_SIZE], TxBulkFIFOBuffer[SCI_TX_BULK_FIFO_SIZE];
 
-#ifndef NO_INTERRUPT
+static UINT16 TxBulkRemaining = 0; /* bytes left of the bulk packet going out */
+static UINT16 TxDropCount[SCI_NB_TX_QUEUES] = { 0 };
 
-static UINT16 SCI0TxRoutinePeriod = 0; /* delay period of transmission process */
+static TSCIReceiveRoutine ReceiveRoutinePtr = (TSCIReceiveRoutine) 0x0000;
+static volatile BOOL isReceiveHeld = bFALSE; /* receive routine refused a byte, bytes queue up in RxFIFO */
+static UINT8 RxRefusedData = 0; /* byte taken out of RxFIFO and refused again, it goes first next time */
+static BOOL isRxRefusedValid = bFALSE;
 
-#define INITIAL_SCI0_TX_ISR_DELAY SCI0TxRoutinePeriod
+#define SCI_BAUD_RATE_DIVISOR_MAXIMUM 0x1FFF /* SBR12..SBR0 */
+#define SCI_BAUD_RATE_TOLERANCE       3      /* largest baud rate error in percent */
 
 /**
- * \fn void interrupt VectorNumber_Vsci0 SCI0RxISR(void)
- * \brief SCI0 receive interrupt service routine. This routine will be executed once the receive data register is full.
+ * \fn TFIFO* SCITxFIFO(const TSCITxQueue queue)
+ * \brief Tells which FIFO buffers given transmit queue
+ * \param queue transmit queue
+ * \return a pointer to the FIFO
  */
-void interrupt VectorNumber_Vsci0 SCI0RxISR(void);
+TFIFO* SCITxFIFO(const TSCITxQueue queue)
+{
+  return (queue == SCI_TX_BULK) ? &TxBulkFIFO : &TxFIFO;
+}
 
 /**
- * \fn void SCI0TxISR(const TTimerChannel channelNb)
- * \brief SCI0 transmission interrupt service routine. This routine will be executed once the timer channel output compare interrupt triggered.
- * \param channelNb timer channel number
+ * \fn BOOL SCIOutNext(UINT8 * const dataPtr)
+ * \brief Takes next byte to transmit. Control bytes go first, but never into the middle of a bulk packet.
+ * \param dataPtr a pointer to memory to store the byte
+ * \return TRUE if there was a byte to transmit
  */
-void SCI0TxISR(const TTimerChannel channelNb);
+BOOL SCIOutNext(UINT8 * const dataPtr)
+{
+  TUINT16 length;
+  
+  if (!TxBulkRemaining)
+  {
+    if (FIFO_Get(&TxFIFO, dataPtr))
+    {
+      return bTRUE;
+    }
+    
+    /* a bulk packet becomes visible whole, its length comes first */
+    if (!FIFO_Get(&TxBulkFIFO, &length.s.Lo) || !FIFO_Get(&TxBulkFIFO, &length.s.Hi))
+    {
+      return bFALSE;
+    }
+    TxBulkRemaining = length.l;
+  }
+  
+  --TxBulkRemaining;
+  return FIFO_Get(&TxBulkFIFO, dataPtr);
+}
 
-void interrupt VectorNumber_Vsci0 SCI0RxISR(void)
+/**
+ * \fn void SCICountDrop(const TSCITxQueue queue)
+ * \brief Counts a packet given transmit queue had no room for
+ * \param queue transmit queue
+ */
+void SCICountDrop(const TSCITxQueue queue)
 {
+  UINT8 savedCCR;
+  
+  EnterCritical();
+  if (TxDropCount[queue] != 0xFFFF)
+  {
+    ++TxDropCount[queue];
+  }
+  ExitCritical();
+}
+
+/**
+ * \fn void SCIReceive(const UINT8 data)
+ * \brief Hands a received byte over to receive routine straight away, or puts it to receive FIFO for later use.
+ *        Once the routine has refused a byte, that byte and every later one wait in the FIFO to keep their order.
+ * \param data received byte
+ */
+void SCIReceive(const UINT8 data)
+{
+  if (ReceiveRoutinePtr && !isReceiveHeld)
+  {
+    if (ReceiveRoutinePtr(data))
+    {
+      return;
+    }
+    isReceiveHeld = bTRUE; /* FIFO is empty while not held, refused byte is first in line */
+  }
+  
+  if (!FIFO_PutSPSC(&RxFIFO, data))
+  { 
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_FIFO_PUT); /* generally, it should not be full. if it does, there is a design issue. */
+#endif
+  }
+}
+
+#ifndef NO_INTERRUPT
+
+/**
+ * \fn void interrupt VectorNumber_Vsci0 SCI0ISR(void)
+ * \brief SCI0 interrupt service routine. This routine will be executed once the receive data register is full
+ *        or, while there is something to send, the transmit data register is empty.
+ */
+void interrupt VectorNumber_Vsci0 SCI0ISR(void);
+
+void interrupt VectorNumber_Vsci0 SCI0ISR(void)
+{
+  UINT8 data = 0;
+  
+  /* handle transmit interrupts before nesting is allowed, an empty register would fire again straight away */
+  if (SCI0CR2_SCTIE)
+  {
+    /* data register is refilled as long as hardware takes it, twice when shifter was idle */
+    while (SCI0SR1_TDRE)
+    {
+      if (!SCIOutNext(&data))
+      {
+        /* nothing left, SCI_Out calls enable it again */
+        SCI0CR2_SCTIE = 0;
+        break;
+      }
+      SCI0DRL = data;
+    }
+  }
   
   /* handle receive interrupts */
   if (SCI0CR2_RIE)
@@ -45,16 +143,10 @@ void interrupt VectorNumber_Vsci0 SCI0RxISR(void)
       SCI0CR2_RIE = 0;
   
       OS_ISREnter();
+      
+      data = SCI0DRL;
     
-      /* put it to receive buffer for later use */
-      if (!FIFO_Put(&RxFIFO, SCI0DRL))
-      { 
-#ifndef NO_DEBUG
-        /* generally, it should not be full. if it does, there is a design issue. */
-        DEBUG(__LINE__, ERR_FIFO_PUT);
-#endif
-
-      }      
+      SCIReceive(data);
 
       OS_ISRExit();                                                      
 
@@ -63,23 +155,6 @@ void interrupt VectorNumber_Vsci0 SCI0RxISR(void)
   }
 }
 
-void SCI0TxISR(const TTimerChannel channelNb)
-{ 
-  /* check if transmission data register is empty */ 
-  if (SCI0SR1_TDRE)
-  { 
-    /* try to obtain one byte from transmission buffer */
-    if (!FIFO_Get(&TxFIFO, &SCI0DRL) || TxFIFO.NbBytes == 0)
-    {       
-      /* disable output compare interrupt of timer channel 7 due to empty buffer */
-      Timer_Enable(TIMER_Ch7, bFALSE);
-      return;
-    }
-  }
-  /* set up delay for next time */
-  Timer_ScheduleRoutine(channelNb, SCI0TxRoutinePeriod);
-}
-
 #endif
 
 /**
@@ -90,25 +165,6 @@ void SCI0TxISR(const TTimerChannel channelNb)
  */
 void SCI_Setup(const UINT32 baudRate, const UINT32 busClk)
 {
-#ifndef NO_INTERRUPT
-
-  TTimerSetup timerCh7;
-  
-  timerCh7.outputCompare    = bTRUE;
-  timerCh7.outputAction     = TIMER_OUTPUT_DISCONNECT;
-  timerCh7.inputDetection   = TIMER_INPUT_OFF;
-  timerCh7.toggleOnOverflow = bFALSE;
-  timerCh7.interruptEnable  = bFALSE;
-  timerCh7.pulseAccumulator = bFALSE;
-  timerCh7.routine          = &SCI0TxISR;
-  
-  /* fuel up our transmission ship docking on channel 7 */
-  Timer_Init(TIMER_Ch7, &timerCh7);
-  
-  /* calculate bus clock cycles that is required to transmit one byte */
-  SCI0TxRoutinePeriod = (UINT16)(10*busClk/baudRate);
-
-#endif
   SCI0BD = (word)(busClk / baudRate / 16); /* baud rate */
   
   /* SCI control register 1 */
@@ -136,8 +192,62 @@ void SCI_Setup(const UINT32 baudRate, const UINT32 busClk)
   SCI0CR2_RWU   = 0;   /* Rx Wakeup                     0=normal               1=enable the wakeup function */
   SCI0CR2_SBK   = 0;   /* Send Break Bit                0=off                  1=on                         */
      
-  FIFO_Init(&RxFIFO); /* initialize receive buffer */    
-  FIFO_Init(&TxFIFO); /* initialize transmit buffer */   
+  FIFO_InitSPSC(&RxFIFO, RxFIFOBuffer, SCI_RX_FIFO_SIZE); /* initialize receive buffer */    
+  FIFO_Init(&TxFIFO, TxFIFOBuffer, SCI_TX_FIFO_SIZE); /* initialize transmit buffer */   
+  FIFO_Init(&TxBulkFIFO, TxBulkFIFOBuffer, SCI_TX_BULK_FIFO_SIZE); /* initialize bulk transmit buffer */   
+}
+
+/**
+ * \fn UINT16 SCI_BaudRateDivisor(const UINT32 baudRate, const UINT32 busClk)
+ * \brief Works out the baud rate divisor closest to given baud rate
+ * \param baudRate the baud rate in bits/sec
+ * \param busClk the bus clock rate in Hz
+ * \return the divisor, 0 if given baud rate cannot be reached within tolerance
+ */
+UINT16 SCI_BaudRateDivisor(const UINT32 baudRate, const UINT32 busClk)
+{
+  UINT32 divisor = 0, actual = 0, error = 0;
+  
+  if (!baudRate)
+  {
+    return 0;
+  }
+  
+  divisor = (busClk + 8 * baudRate) / (16 * baudRate); /* rounded */
+  if (divisor == 0 || divisor > SCI_BAUD_RATE_DIVISOR_MAXIMUM)
+  {
+    return 0;
+  }
+  
+  actual = busClk / (16 * divisor);
+  error = (actual > baudRate) ? actual - baudRate : baudRate - actual;
+  if (error * 100 > baudRate * SCI_BAUD_RATE_TOLERANCE)
+  {
+    return 0;
+  }
+  
+  return (UINT16)divisor;
+}
+
+/**
+ * \fn BOOL SCI_SetBaudRate(const UINT32 baudRate, const UINT32 busClk)
+ * \brief Changes the baud rate on the fly, FIFO buffers are left alone.
+ * \param baudRate the baud rate in bits/sec
+ * \param busClk the bus clock rate in Hz
+ * \return TRUE if the baud rate can be reached and has been set
+ * \warning Bytes still being shifted out are corrupted, wait for SCI_OutIdle first.
+ */
+BOOL SCI_SetBaudRate(const UINT32 baudRate, const UINT32 busClk)
+{
+  UINT16 divisor = SCI_BaudRateDivisor(baudRate, busClk);
+  
+  if (!divisor)
+  {
+    return bFALSE;
+  }
+  
+  SCI0BD = divisor;
+  return bTRUE;
 }
 
 /**
@@ -147,29 +257,87 @@ void SCI_Setup(const UINT32 baudRate, const UINT32 busClk)
  */
 void SCI_Poll(void)
 {
+  UINT8 data = 0;
+  
   /* check receive data register full flag */
   if (SCI0SR1_RDRF)
   { 
-    /* put it to receive buffer for later use */
-    if (!FIFO_Put(&RxFIFO, SCI0DRL))
-    { 
-#ifndef NO_DEBUG
-      DEBUG(__LINE__, ERR_FIFO_PUT); /* generally, it should not be full. if it does, there is a design issue. */
-#endif
-    }                                    
+    data = SCI0DRL;
+    
+    SCIReceive(data);
   }
   
   /* check transmit data register empty flag */
   if (SCI0SR1_TDRE)
   { 
-    /* try to get one byte from transmit buffer */
-    (void)FIFO_Get(&TxFIFO, &SCI0DRL);
+    /* try to get one byte from transmit buffers */
+    if (SCIOutNext(&data))
+    {
+      SCI0DRL = data;
+    }
   }    
 }
 
+/**
+ * \fn void SCI_AttachReceiveRoutine(const TSCIReceiveRoutine routine)
+ * \brief Attaches a routine that takes every received byte instead of the receive FIFO.
+ * \param routine receive routine, it runs in interrupt context unless NO_INTERRUPT is defined, or in SCI_ResumeReceive caller context
+ */
+void SCI_AttachReceiveRoutine(const TSCIReceiveRoutine routine)
+{
+  ReceiveRoutinePtr = routine;
+}
+
+/**
+ * \fn void SCI_ResumeReceive(void)
+ * \brief Hands bytes held in the receive FIFO since the receive routine refused one back to it, in order.
+ *        Routine takes bytes straight from interrupt again once the FIFO is empty.
+ * \warning Do not mix with SCI_InChar while a receive routine is attached.
+ */
+void SCI_ResumeReceive(void)
+{
+  UINT8 data = 0;
+  UINT8 savedCCR;
+  
+  /* receive interrupt leaves routine alone while bytes are held, so it is called from here only */
+  if (!isReceiveHeld || !ReceiveRoutinePtr)
+  {
+    return;
+  }
+  
+  if (isRxRefusedValid)
+  {
+    if (!ReceiveRoutinePtr(RxRefusedData))
+    {
+      return;
+    }
+    isRxRefusedValid = bFALSE;
+  }
+  
+  for (;;)
+  {
+    /* emptiness and release are decided together, a byte coming in meanwhile would overtake the held ones */
+    EnterCritical();
+    if (!FIFO_GetSPSC(&RxFIFO, &data))
+    {
+      isReceiveHeld = bFALSE;
+      ExitCritical();
+      return;
+    }
+    ExitCritical();
+    
+    if (!ReceiveRoutinePtr(data))
+    {
+      RxRefusedData = data;
+      isRxRefusedValid = bTRUE;
+      return;
+    }
+  }
+}
+
 /**
  * \fn BOOL SCI_InChar(UINT8 * const dataPtr)
- * \see FIFO_Get
+ * \see FIFO_GetSPSC
  * \brief Get a character from the receive FIFO if it is not empty.
  * \param dataPtr a pointer to memory to store the retrieved byte
  * \return TRUE if the receive FIFO returned a character
@@ -179,7 +347,7 @@ BOOL SCI_InChar(UINT8 * const dataPtr)
 {
   if (dataPtr)
   {
-    return FIFO_Get(&RxFIFO, dataPtr);   
+    return FIFO_GetSPSC(&RxFIFO, dataPtr);   
   }
 #ifndef NO_DEBUG
   DEBUG(__LINE__, ERR_INVALID_POINTER);
@@ -201,14 +369,141 @@ BOOL SCI_OutChar(const UINT8 data)
   if (FIFO_Put(&TxFIFO, data))
   {
 #ifndef NO_INTERRUPT  
-    if (!Timer_Enabled(TIMER_Ch7))
-    {      
-      /* kick start our hitchhiker here */
-      Timer_Set(TIMER_Ch7, INITIAL_SCI0_TX_ISR_DELAY);
-      Timer_Enable(TIMER_Ch7, bTRUE);
-    }
+    /* transmit interrupt takes it from here */
+    SCI0CR2_SCTIE = 1;
 #endif
     return bTRUE;
   }
+  SCICountDrop(SCI_TX_CONTROL);
   return bFALSE;
 }
+
+/**
+ * \fn BOOL SCI_OutReserve(const TSCITxQueue queue, const UINT16 nbBytes, TSCIReservation * const reservationPtr)
+ * \see FIFO_Reserve
+ * \brief Takes room for given number of bytes in a transmit queue, they are not sent until committed.
+ * \param queue transmit queue
+ * \param nbBytes number of bytes, a packet at most as bulk packets are never split
+ * \param reservationPtr a pointer to a reservation to fill in
+ * \return TRUE if there was room in the transmit queue
+ * \warning Assumes the transmit FIFOs have been initialized.
+ */
+BOOL SCI_OutReserve(const TSCITxQueue queue, const UINT16 nbBytes, TSCIReservation * const reservationPtr)
+{
+  if (!reservationPtr || queue >= SCI_NB_TX_QUEUES || !nbBytes)
+  {
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_INVALID_ARGUMENT);
+#endif
+    return bFALSE;
+  }
+  
+  reservationPtr->queue = queue;
+  
+  if (queue == SCI_TX_BULK)
+  {
+    if (!FIFO_Reserve(&TxBulkFIFO, SCI_TX_BULK_HEADER_SIZE + nbBytes, &reservationPtr->fifoReservation))
+    {
+      SCICountDrop(queue);
+      return bFALSE;
+    }
+    
+    /* transmit interrupt reads length to keep the packet in one piece */
+    FIFO_Write(&TxBulkFIFO, &reservationPtr->fifoReservation, 0, (UINT8)nbBytes);
+    FIFO_Write(&TxBulkFIFO, &reservationPtr->fifoReservation, 1, (UINT8)(nbBytes >> 8));
+    return bTRUE;
+  }
+  
+  if (!FIFO_Reserve(&TxFIFO, nbBytes, &reservationPtr->fifoReservation))
+  {
+    SCICountDrop(queue);
+    return bFALSE;
+  }
+  return bTRUE;
+}
+
+/**
+ * \fn void SCI_OutWrite(const TSCIReservation * const reservationPtr, const UINT16 offset, const UINT8 data)
+ * \see FIFO_Write
+ * \brief Stores a byte into room reserved in a transmit queue.
+ * \param reservationPtr a pointer to the reservation
+ * \param offset position of the byte within the reservation
+ * \param data a byte to be sent
+ */
+void SCI_OutWrite(const TSCIReservation * const reservationPtr, const UINT16 offset, const UINT8 data)
+{
+  if (reservationPtr->queue == SCI_TX_BULK)
+  {
+    FIFO_Write(&TxBulkFIFO, &reservationPtr->fifoReservation, SCI_TX_BULK_HEADER_SIZE + offset, data);
+    return;
+  }
+  FIFO_Write(&TxFIFO, &reservationPtr->fifoReservation, offset, data);
+}
+
+/**
+ * \fn void SCI_OutWriteBlock(const TSCIReservation * const reservationPtr, const UINT16 offset, const UINT8 * const dataPtr, const UINT16 nbBytes)
+ * \see FIFO_WriteBlock
+ * \brief Stores given bytes into room reserved in a transmit queue.
+ * \param reservationPtr a pointer to the reservation
+ * \param offset position of the first byte within the reservation
+ * \param dataPtr a pointer to bytes to be sent
+ * \param nbBytes number of bytes
+ */
+void SCI_OutWriteBlock(const TSCIReservation * const reservationPtr, const UINT16 offset, const UINT8 * const dataPtr, const UINT16 nbBytes)
+{
+  if (reservationPtr->queue == SCI_TX_BULK)
+  {
+    FIFO_WriteBlock(&TxBulkFIFO, &reservationPtr->fifoReservation, SCI_TX_BULK_HEADER_SIZE + offset, dataPtr, nbBytes);
+    return;
+  }
+  FIFO_WriteBlock(&TxFIFO, &reservationPtr->fifoReservation, offset, dataPtr, nbBytes);
+}
+
+/**
+ * \fn void SCI_OutCommit(const TSCIReservation * const reservationPtr)
+ * \see FIFO_Commit
+ * \brief Hands room reserved in a transmit queue over for transmission.
+ * \param reservationPtr a pointer to the reservation
+ */
+void SCI_OutCommit(const TSCIReservation * const reservationPtr)
+{
+  FIFO_Commit(SCITxFIFO(reservationPtr->queue), &reservationPtr->fifoReservation);
+#ifndef NO_INTERRUPT  
+  /* transmit interrupt takes it from here */
+  SCI0CR2_SCTIE = 1;
+#endif
+}
+
+/**
+ * \fn UINT16 SCI_OutFree(const TSCITxQueue queue)
+ * \brief Tells how many bytes a transmit queue can still take, bulk packets take SCI_TX_BULK_HEADER_SIZE more
+ * \param queue transmit queue
+ * \return number of free bytes in the transmit queue
+ * \warning Assumes the transmit FIFOs have been initialized.
+ */
+UINT16 SCI_OutFree(const TSCITxQueue queue)
+{
+  return FIFO_Free(SCITxFIFO(queue));
+}
+
+/**
+ * \fn UINT16 SCI_OutDropped(const TSCITxQueue queue)
+ * \brief Tells how many times a transmit queue had no room, it saturates at 0xFFFF
+ * \param queue transmit queue
+ * \return number of refused packets
+ */
+UINT16 SCI_OutDropped(const TSCITxQueue queue)
+{
+  return (queue < SCI_NB_TX_QUEUES) ? TxDropCount[queue] : 0;
+}
+
+/**
+ * \fn BOOL SCI_OutIdle(void)
+ * \brief Tells whether everything placed in the transmit FIFO has left the shifter
+ * \return TRUE if the transmitter is idle
+ * \warning Assumes the transmit FIFO has been initialized.
+ */
+BOOL SCI_OutIdle(void)
+{
+  return FIFO_Free(&TxFIFO) == TxFIFO.Size && FIFO_Free(&TxBulkFIFO) == TxBulkFIFO.Size && !TxBulkRemaining && SCI0SR1_TC;
+}
@@ -8,6 +8,65 @@
 #define SCI_H
 
 #include "global.h"
+#include "FIFO.h"
+
+/**
+ * SCI receive FIFO buffer capacity
+ */
+#ifndef CONFIG_SCI_RX_FIFO_SIZE
+#define SCI_RX_FIFO_SIZE 256 /* fallback plan */
+#warning "SCI_RX_FIFO_SIZE using fallback setting 256"
+#else
+#define SCI_RX_FIFO_SIZE CONFIG_SCI_RX_FIFO_SIZE
+#endif
+
+/**
+ * SCI transmit FIFO buffer capacity
+ */
+#ifndef CONFIG_SCI_TX_FIFO_SIZE
+#define SCI_TX_FIFO_SIZE 256 /* fallback plan */
+#warning "SCI_TX_FIFO_SIZE using fallback setting 256"
+#else
+#define SCI_TX_FIFO_SIZE CONFIG_SCI_TX_FIFO_SIZE
+#endif
+
+/**
+ * SCI bulk transmit FIFO buffer capacity
+ */
+#ifndef CONFIG_SCI_TX_BULK_FIFO_SIZE
+#define SCI_TX_BULK_FIFO_SIZE 256 /* fallback plan */
+#warning "SCI_TX_BULK_FIFO_SIZE using fallback setting 256"
+#else
+#define SCI_TX_BULK_FIFO_SIZE CONFIG_SCI_TX_BULK_FIFO_SIZE
+#endif
+
+/**
+ * Bytes in front of every bulk packet in its FIFO buffer, they are not sent
+ */
+#define SCI_TX_BULK_HEADER_SIZE 2
+
+/**
+ * Number of transmit queues
+ */
+#define SCI_NB_TX_QUEUES 2
+
+typedef enum
+{
+  SCI_TX_CONTROL, /* command responses, always drained first */
+  SCI_TX_BULK     /* streaming data, goes out a whole packet at a time when control is empty */
+} TSCITxQueue;
+
+/* Room reserved in a transmit queue */
+typedef struct
+{
+  TFIFOReservation fifoReservation;
+  TSCITxQueue queue;
+} TSCIReservation;
+
+/**
+ * \brief Routine takes a received byte, FALSE refuses it and leaves it and every later byte in the receive FIFO
+ */
+typedef BOOL (*TSCIReceiveRoutine)(const UINT8 data);
 
 /**
  * \fn void SCI_Setup(const UINT32 baudRate, const UINT32 busClk) 
@@ -16,6 +75,25 @@
  * \param busClk the bus clock rate in Hz
  */
 void SCI_Setup(const UINT32 baudRate, const UINT32 busClk);
+
+/**
+ * \fn UINT16 SCI_BaudRateDivisor(const UINT32 baudRate, const UINT32 busClk)
+ * \brief Works out the baud rate divisor closest to given baud rate
+ * \param baudRate the baud rate in bits/sec
+ * \param busClk the bus clock rate in Hz
+ * \return the divisor, 0 if given baud rate cannot be reached within tolerance
+ */
+UINT16 SCI_BaudRateDivisor(const UINT32 baudRate, const UINT32 busClk);
+
+/**
+ * \fn BOOL SCI_SetBaudRate(const UINT32 baudRate, const UINT32 busClk)
+ * \brief Changes the baud rate on the fly, FIFO buffers are left alone.
+ * \param baudRate the baud rate in bits/sec
+ * \param busClk the bus clock rate in Hz
+ * \return TRUE if the baud rate can be reached and has been set
+ * \warning Bytes still being shifted out are corrupted, wait for SCI_OutIdle first.
+ */
+BOOL SCI_SetBaudRate(const UINT32 baudRate, const UINT32 busClk);
  
 /**
  * \fn void SCI_Poll(void)
@@ -24,16 +102,31 @@ void SCI_Setup(const UINT32 baudRate, const UINT32 busClk);
  */
 void SCI_Poll(void);
 
+/**
+ * \fn void SCI_AttachReceiveRoutine(const TSCIReceiveRoutine routine)
+ * \brief Attaches a routine that takes every received byte instead of the receive FIFO.
+ * \param routine receive routine, it runs in interrupt context unless NO_INTERRUPT is defined, or in SCI_ResumeReceive caller context
+ */
+void SCI_AttachReceiveRoutine(const TSCIReceiveRoutine routine);
+
+/**
+ * \fn void SCI_ResumeReceive(void)
+ * \brief Hands bytes held in the receive FIFO since the receive routine refused one back to it, in order.
+ *        Routine takes bytes straight from interrupt again once the FIFO is empty.
+ * \warning Do not mix with SCI_InChar while a receive routine is attached.
+ */
+void SCI_ResumeReceive(void);
+
 /**
  * \fn BOOL SCI_InChar(UINT8 * const dataPtr)
- * \see FIFO_Get
+ * \see FIFO_GetSPSC
  * \brief Get a character from the receive FIFO if it is not empty.
  * \param dataPtr a pointer to memory to store the retrieved byte
  * \return TRUE if the receive FIFO returned a character
  * \warning Assumes the receive FIFO has been initialized.
  */
-BOOL SCI_InChar(UINT8 * const dataPtr);  
- 
+BOOL SCI_InChar(UINT8 * const dataPtr);
+
 /**
  * \fn BOOL SCI_OutChar(const UINT8 data)
  * \see FIFO_Put
@@ -44,4 +137,70 @@ BOOL SCI_InChar(UINT8 * const dataPtr);
  */
 BOOL SCI_OutChar(const UINT8 data);
 
+/**
+ * \fn BOOL SCI_OutReserve(const TSCITxQueue queue, const UINT16 nbBytes, TSCIReservation * const reservationPtr)
+ * \see FIFO_Reserve
+ * \brief Takes room for given number of bytes in a transmit queue, they are not sent until committed.
+ * \param queue transmit queue
+ * \param nbBytes number of bytes, a packet at most as bulk packets are never split
+ * \param reservationPtr a pointer to a reservation to fill in
+ * \return TRUE if there was room in the transmit queue, otherwise its drop counter goes up
+ * \warning Assumes the transmit FIFOs have been initialized.
+ */
+BOOL SCI_OutReserve(const TSCITxQueue queue, const UINT16 nbBytes, TSCIReservation * const reservationPtr);
+
+/**
+ * \fn void SCI_OutWrite(const TSCIReservation * const reservationPtr, const UINT16 offset, const UINT8 data)
+ * \see FIFO_Write
+ * \brief Stores a byte into room reserved in a transmit queue.
+ * \param reservationPtr a pointer to the reservation
+ * \param offset position of the byte within the reservation
+ * \param data a byte to be sent
+ */
+void SCI_OutWrite(const TSCIReservation * const reservationPtr, const UINT16 offset, const UINT8 data);
+
+/**
+ * \fn void SCI_OutWriteBlock(const TSCIReservation * const reservationPtr, const UINT16 offset, const UINT8 * const dataPtr, const UINT16 nbBytes)
+ * \see FIFO_WriteBlock
+ * \brief Stores given bytes into room reserved in a transmit queue.
+ * \param reservationPtr a pointer to the reservation
+ * \param offset position of the first byte within the reservation
+ * \param dataPtr a pointer to bytes to be sent
+ * \param nbBytes number of bytes
+ */
+void SCI_OutWriteBlock(const TSCIReservation * const reservationPtr, const UINT16 offset, const UINT8 * const dataPtr, const UINT16 nbBytes);
+
+/**
+ * \fn void SCI_OutCommit(const TSCIReservation * const reservationPtr)
+ * \see FIFO_Commit
+ * \brief Hands room reserved in a transmit queue over for transmission.
+ * \param reservationPtr a pointer to the reservation
+ */
+void SCI_OutCommit(const TSCIReservation * const reservationPtr);
+
+/**
+ * \fn UINT16 SCI_OutFree(const TSCITxQueue queue)
+ * \brief Tells how many bytes a transmit queue can still take, bulk packets take SCI_TX_BULK_HEADER_SIZE more
+ * \param queue transmit queue
+ * \return number of free bytes in the transmit queue
+ * \warning Assumes the transmit FIFOs have been initialized.
+ */
+UINT16 SCI_OutFree(const TSCITxQueue queue);
+
+/**
+ * \fn UINT16 SCI_OutDropped(const TSCITxQueue queue)
+ * \brief Tells how many times a transmit queue had no room, it saturates at 0xFFFF
+ * \param queue transmit queue
+ * \return number of refused packets
+ */
+UINT16 SCI_OutDropped(const TSCITxQueue queue);
+
+/**
+ * \fn BOOL SCI_OutIdle(void)
+ * \brief Tells whether everything placed in both transmit queues has left the shifter
+ * \return TRUE if the transmitter is idle
+ * \warning Assumes the transmit FIFO has been initialized.
+ */
+BOOL SCI_OutIdle(void);
+
 #endif
\ No newline at end of file
@@ -7,6 +7,112 @@
 #include "SPI.h"
 #include <mc9s12a512.h>
 
+#if (SPI_QUEUE_SIZE & (SPI_QUEUE_SIZE - 1)) || SPI_QUEUE_SIZE > 128
+#error "SPI_QUEUE_SIZE must be a power of two not larger than 128."
+#endif
+
+#define SPI_QUEUE_MASK (SPI_QUEUE_SIZE - 1)
+
+typedef struct
+{
+  volatile UINT8 head;     /* free running index of next free entry */
+  volatile UINT8 tail;     /* free running index of transaction on the bus */
+  UINT8 byteIndex;         /* byte of current transaction on the bus */
+  volatile BOOL isBusy;
+  
+  TSPITransaction transaction[SPI_QUEUE_SIZE];
+  
+} TSPIQueue;
+
+static TSPIQueue SPIQueue = {0};
+
+#ifndef NO_INTERRUPT
+
+/**
+ * \fn void interrupt VectorNumber_Vspi0 SPI0ISR(void)
+ * \brief SPI0 interrupt service routine. This routine will be executed once a byte has been exchanged.
+ * \note It keeps interrupts masked, completion routines must not call OS.
+ */
+void interrupt VectorNumber_Vspi0 SPI0ISR(void);
+
+#endif
+
+/**
+ * \fn void SPIStartTransaction(void)
+ * \brief Selects chip of transaction at queue tail and sends its first byte
+ * \warning Interrupts must be masked
+ */
+void SPIStartTransaction(void)
+{
+  TSPITransaction* const transactionPtr = &SPIQueue.transaction[SPIQueue.tail & SPI_QUEUE_MASK];
+  
+  SPIQueue.isBusy = bTRUE;
+  SPIQueue.byteIndex = 0;
+  
+  SPI0CS = transactionPtr->chipSelect; /* select listener */
+  
+  /* bus is idle or last exchange has just been collected, so SPTEF is already set and this passes on first read.
+     The read stays anyway as SPI0DR is only taken after SPI0SR has been read with SPTEF set. */
+  while(!SPI0SR_SPTEF);
+  SPI0DR = transactionPtr->data[0];
+}
+
+/**
+ * \fn void SPIExchangeNext(void)
+ * \brief Collects received byte of current transaction and moves on to its next byte or the next transaction
+ * \warning Interrupts must be masked
+ */
+void SPIExchangeNext(void)
+{
+  TSPITransaction* const transactionPtr = &SPIQueue.transaction[SPIQueue.tail & SPI_QUEUE_MASK];
+  
+  transactionPtr->data[SPIQueue.byteIndex] = SPI0DR;
+  
+  if (++SPIQueue.byteIndex < transactionPtr->nbBytes)
+  {
+    SPI0DR = transactionPtr->data[SPIQueue.byteIndex];
+    return;
+  }
+  
+  SPI0CS = SPI0CS_NULL; /* deselect any chip */
+  
+  if (transactionPtr->completionRoutine)
+  {
+    transactionPtr->completionRoutine(transactionPtr->tag, transactionPtr->data);
+  }
+  
+  ++SPIQueue.tail;
+  
+  if (SPIQueue.head != SPIQueue.tail)
+  {
+    SPIStartTransaction();
+  }
+  else
+  {
+    SPIQueue.isBusy = bFALSE;
+  }
+}
+
+#ifndef NO_INTERRUPT
+
+void interrupt VectorNumber_Vspi0 SPI0ISR(void)
+{
+  /* reading status then data register clears the flag, a stray one is cleared even though nobody wants its byte */
+  if (!SPIQueue.isBusy)
+  {
+    (void)SPI0SR;
+    (void)SPI0DR;
+    return;
+  }
+  
+  if (SPI0SR_SPIF)
+  {
+    SPIExchangeNext();
+  }
+}
+
+#endif
+
 /**
  * \fn void SPI_Setup(const TSPISetup * const aSPISetup, const UINT32 busClk)
  * \brief Sets up the Serial Peripheral Interface
@@ -39,7 +145,11 @@ void SPI_Setup(const TSPISetup * const aSPISetup, const UINT32 busClk)
     SPI0BR_SPR  = (byte)(spr - 1);
     SPI0BR_SPPR = (byte)(sppr - 1);
     
+#ifndef NO_INTERRUPT
+    SPI0CR1_SPIE  = 1;                               /* SPI Interrupt Enable          1= on     0= off   */
+#else
     SPI0CR1_SPIE  = 0;                               /* SPI Interrupt Enable          1= on     0= off   */
+#endif
     SPI0CR1_MSTR  = (byte)aSPISetup->isMaster;       /* SPI Master/Slave Mode Select  1= master 0= slave */
     SPI0CR1_SPTIE = 0;                               /* SPI Transmit Interrupt Enable 1= on     0= off   */
     SPI0CR1_CPOL  = (byte)aSPISetup->activeLowClock; /* SPI Clock Polarity            1= low    0= high  */
@@ -80,3 +190,57 @@ void SPI_ExchangeChar(const UINT8 dataTx, UINT8 * const dataRx)
     *dataRx = SPI0DR;
   }
 }
+
+/**
+ * \fn BOOL SPI_Post(const TSPITransaction * const aTransaction)
+ * \brief Copies given transaction into queue and returns straight away. Transactions are
+ *        exchanged in order by SPI interrupt, completion routine runs in interrupt context.
+ * \param aTransaction transaction to exchange
+ * \return FALSE if queue is full or transaction is not valid
+ * \warning Assumes SPI has been set up. Do not mix with SPI_ExchangeChar.
+ */
+BOOL SPI_Post(const TSPITransaction * const aTransaction)
+{
+  UINT8 savedCCR;
+  
+  if (!aTransaction || aTransaction->nbBytes == 0 || aTransaction->nbBytes > SPI_TRANSACTION_SIZE)
+  {
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_INVALID_ARGUMENT);
+#endif
+    return bFALSE;
+  }
+  
+  /* callers come from threads and ISRs alike */
+  EnterCritical();
+  
+  if ((UINT8)(SPIQueue.head - SPIQueue.tail) >= SPI_QUEUE_SIZE)
+  {
+    ExitCritical();
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_SPI_QUEUE);
+#endif
+    return bFALSE;
+  }
+  
+  SPIQueue.transaction[SPIQueue.head & SPI_QUEUE_MASK] = *aTransaction;
+  ++SPIQueue.head;
+  
+  if (!SPIQueue.isBusy)
+  {
+    SPIStartTransaction();
+  }
+  
+#ifdef NO_INTERRUPT
+  /* without SPI interrupt the whole queue is exchanged here */
+  while (SPIQueue.isBusy)
+  {
+    while(!SPI0SR_SPIF);
+    SPIExchangeNext();
+  }
+#endif
+  
+  ExitCritical();
+  
+  return bTRUE;
+}
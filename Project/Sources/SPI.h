@@ -9,6 +9,26 @@
 
 #include "global.h"
 
+#ifndef CONFIG_SPI_QUEUE_SIZE
+#define SPI_QUEUE_SIZE 16 /* fallback plan */
+#warning "SPI_QUEUE_SIZE using fallback setting 16"
+#else
+#define SPI_QUEUE_SIZE CONFIG_SPI_QUEUE_SIZE
+#endif
+
+#define SPI_TRANSACTION_SIZE 3 /* longest exchange, one ADC conversion */
+
+typedef void (*TSPICompletionRoutine)(const UINT8 tag, const UINT8* const dataRx);
+
+typedef struct
+{
+  UINT8 chipSelect;                        /* SPI0CS value during the exchange */
+  UINT8 nbBytes;
+  UINT8 data[SPI_TRANSACTION_SIZE];        /* bytes to transmit, replaced by received bytes */
+  UINT8 tag;                               /* handed to completion routine as it is */
+  TSPICompletionRoutine completionRoutine; /* NULL if received bytes are not wanted */
+} TSPITransaction;
+
 typedef struct
 {
   BOOL isMaster;
@@ -40,4 +60,14 @@ void SPI_Setup(const TSPISetup * const aSPISetup, const UINT32 busClk);
  */
 void SPI_ExchangeChar(const UINT8 dataTx, UINT8 * const dataRx);
 
+/**
+ * \fn BOOL SPI_Post(const TSPITransaction * const aTransaction)
+ * \brief Copies given transaction into queue and returns straight away. Transactions are
+ *        exchanged in order by SPI interrupt, completion routine runs in interrupt context.
+ * \param aTransaction transaction to exchange
+ * \return FALSE if queue is full or transaction is not valid
+ * \warning Assumes SPI has been set up. Do not mix with SPI_ExchangeChar.
+ */
+BOOL SPI_Post(const TSPITransaction * const aTransaction);
+
 #endif
@@ -6,6 +6,7 @@
  */
 #include "analog.h"
 #include "SPI.h"
+#include "timer.h"
 #include "utils.h"
 #include <mc9s12a512.h>
 
@@ -15,6 +16,174 @@ TAnalogOutput Analog_Output[NB_OUTPUT_CHANNELS] = { 0 };
 #define ADC_OFFSET 0x0800
 #define DAC_OFFSET 0x1000
 
+#define DAC_POWER_UP   0b00100000 /* /PD */
+#define DAC_LOAD_ONLY  0b00010000 /* /LDAC, input register is loaded but output is left alone */
+
+static volatile BOOL AnalogInputChanged[NB_INPUT_CHANNELS] = { 0 };
+
+INT16 Analog_CaptureBuffer[ANALOG_CAPTURE_SIZE] = { 0 };
+
+/* Capture shared by thread, timer channel 7 and SPI interrupts */
+static struct
+{
+  volatile TAnalogCaptureState state;
+  UINT8 channelMask;
+  UINT8 triggerIndex;     /* lowest selected channel, every sample period starts with it */
+  TAnalogTrigger trigger;
+  INT16 level;
+  INT16 lastValue;        /* previous sample of trigger channel */
+  BOOL hasLastValue;
+  UINT16 period;          /* bus clock cycles */
+  UINT16 length;          /* samples across all selected channels */
+  volatile UINT16 nbSamples;
+  UINT8 nbPending;        /* conversions posted and not back yet */
+} AnalogCapture = { ANALOG_CAPTURE_IDLE };
+
+/**
+ * \fn void AnalogGetComplete(const UINT8 index, const UINT8* const dataRx)
+ * \brief Filters conversion received from ADC into given analog input
+ * \param index analog input index
+ * \param dataRx bytes received from ADC
+ */
+void AnalogGetComplete(const UINT8 index, const UINT8* const dataRx)
+{
+  TINT16 value;
+  
+  value.s.Hi = dataRx[1] & 0b00001111; /* X  | X  | X  | 0  | B11 | B10 | B9 | B8 */
+  value.s.Lo = dataRx[2];              /* B7 | B6 | B5 | B4 | B3  | B2  | B1 | B0 */
+  value.l = ADC_OFFSET - value.l;
+      
+  Analog_Input[index].Value3 = Analog_Input[index].Value2;  
+  Analog_Input[index].Value2 = Analog_Input[index].Value1;  
+  Analog_Input[index].Value1 = value.l;  
+  Analog_Input[index].OldValue.l = Analog_Input[index].Value.l;
+      
+  Analog_Input[index].Value.l = FindMedianOfThreeNumbers(Analog_Input[index].Value1,
+  															                         Analog_Input[index].Value2,
+  															                         Analog_Input[index].Value3);
+  
+  AnalogInputChanged[index] = AnalogInputChanged[index] || (Analog_Input[index].Value.l != Analog_Input[index].OldValue.l);
+}
+
+/**
+ * \fn void AnalogCaptureStop(const TAnalogCaptureState state)
+ * \brief Stops sampling
+ * \param state state capture stops in
+ * \note Called from interrupt context only, SPI interrupt does not tell OS so nobody is woken up from here.
+ */
+void AnalogCaptureStop(const TAnalogCaptureState state)
+{
+  Timer_Enable(TIMER_Ch7, bFALSE);
+  AnalogCapture.state = state;
+}
+
+/**
+ * \fn void AnalogCaptureComplete(const UINT8 index, const UINT8* const dataRx)
+ * \brief Stores conversion received from ADC into capture buffer once trigger has fired, raw as an oscilloscope wants it
+ * \param index analog input index
+ * \param dataRx bytes received from ADC
+ */
+void AnalogCaptureComplete(const UINT8 index, const UINT8* const dataRx)
+{
+  TINT16 value;
+  BOOL fired = bFALSE;
+  
+  value.s.Hi = dataRx[1] & 0b00001111; /* X  | X  | X  | 0  | B11 | B10 | B9 | B8 */
+  value.s.Lo = dataRx[2];              /* B7 | B6 | B5 | B4 | B3  | B2  | B1 | B0 */
+  value.l = ADC_OFFSET - value.l;
+  
+  if (AnalogCapture.nbPending)
+  {
+    --AnalogCapture.nbPending;
+  }
+  
+  if (AnalogCapture.state == ANALOG_CAPTURE_ARMED)
+  {
+    /* samples before trigger has fired are thrown away */
+    if (index != AnalogCapture.triggerIndex)
+    {
+      return;
+    }
+    
+    if (AnalogCapture.hasLastValue)
+    {
+      fired = (AnalogCapture.trigger == ANALOG_TRIGGER_RISING) ?
+              (AnalogCapture.lastValue < AnalogCapture.level && value.l >= AnalogCapture.level) :
+              (AnalogCapture.lastValue > AnalogCapture.level && value.l <= AnalogCapture.level);
+    }
+    AnalogCapture.lastValue = value.l;
+    AnalogCapture.hasLastValue = bTRUE;
+    
+    if (!fired)
+    {
+      return;
+    }
+    AnalogCapture.state = ANALOG_CAPTURE_RUNNING;
+  }
+  
+  if (AnalogCapture.state != ANALOG_CAPTURE_RUNNING)
+  {
+    return;
+  }
+  
+  Analog_CaptureBuffer[AnalogCapture.nbSamples] = value.l;
+  
+  if (++AnalogCapture.nbSamples >= AnalogCapture.length)
+  {
+    AnalogCaptureStop(ANALOG_CAPTURE_DONE);
+  }
+}
+
+/**
+ * \fn void AnalogCaptureRoutine(const TTimerChannel channelNb)
+ * \brief Starts conversions of every captured channel once a sample period
+ * \param channelNb timer channel
+ */
+void AnalogCaptureRoutine(const TTimerChannel channelNb)
+{
+  static const UINT8 commandLookupTable[NB_INPUT_CHANNELS][2] = { { 0b00000110, 0b00000000 }, /* START | SGL/DIFF | D2, D1 | D0 */
+                                                                  { 0b00000110, 0b01000000 },
+                                                                  { 0b00000110, 0b10000000 },
+                                                                  { 0b00000110, 0b11000000 },
+                                                                  { 0b00000111, 0b00000000 },
+                                                                  { 0b00000111, 0b01000000 },
+                                                                  { 0b00000111, 0b10000000 },
+                                                                  { 0b00000111, 0b11000000 } };
+  UINT8 index = 0;
+  TSPITransaction transaction;
+  
+  Timer_ScheduleRoutine(channelNb, AnalogCapture.period);
+  
+  /* last sample period has not been converted yet, interleaving would be lost */
+  if (AnalogCapture.nbPending)
+  {
+    AnalogCaptureStop(ANALOG_CAPTURE_OVERRUN);
+    return;
+  }
+  
+  transaction.chipSelect = SPI0CS_ADC; /* select ADC chip as our listener */
+  transaction.nbBytes = 3;
+  transaction.data[2] = 0;
+  transaction.completionRoutine = &AnalogCaptureComplete;
+  
+  for (index = 0; index < NB_INPUT_CHANNELS; ++index)
+  {
+    if (AnalogCapture.channelMask & (1 << index))
+    {
+      transaction.data[0] = commandLookupTable[index][0];
+      transaction.data[1] = commandLookupTable[index][1];
+      transaction.tag = index;
+      
+      if (!SPI_Post(&transaction))
+      {
+        AnalogCaptureStop(ANALOG_CAPTURE_OVERRUN);
+        return;
+      }
+      ++AnalogCapture.nbPending;
+    }
+  }
+}
+
 /**
  * \fn void Analog_Setup(const UINT32 busClk)
  * \brief Sets up the ADC and DAC
@@ -35,15 +204,26 @@ void Analog_Setup(const UINT32 busClk) {
 }
 
 /**
- * \fn BOOL Analog_Get(const TAnalogChannel channelNb)
+ * \fn BOOL Analog_Get(const TAnalogChannel channelNb, BOOL* const changedPtr)
  * \brief Gets an analog input channel's value 
  * \param channelNb the number of the anlog input channel to read
- * \return a Boolean value indicating if the channel reading was changed
+ * \param changedPtr a pointer to store whether the channel reading was changed by conversions finished since last call
+ * \return TRUE if a conversion was queued, FALSE if SPI queue was full and Analog_Input is left as it is
+ * \note It only starts a conversion, Analog_Input is updated once the conversion has finished
  * \warning Assumes that the ADC has been set up   
  */
-BOOL Analog_Get(const TAnalogChannel channelNb) {
-  UINT8 index = 0xFF, cache1 = 0, cache2 = 0, cache3 = 0;
-  TINT16 value;
+BOOL Analog_Get(const TAnalogChannel channelNb, BOOL* const changedPtr) {
+  UINT8 index = 0xFF, cache1 = 0, cache2 = 0;
+  TSPITransaction transaction;
+  BOOL isQueued = bFALSE;
+  
+  if (!changedPtr)
+  {
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_INVALID_POINTER);
+#endif    
+    return bFALSE;
+  }
   
   /* load hardware related data into caches for SPI exchanging */
   /* NOTE: channel enums might not be in numeric order         */
@@ -97,38 +277,35 @@ BOOL Analog_Get(const TAnalogChannel channelNb) {
       break;
   }
     
-  SPI0CS = SPI0CS_ADC;     /* select ADC chip as our listener */
-  SPI_ExchangeChar(cache1, &cache1); /* X  | X  | X  | X  | X   | X   | X  | X  */
-  SPI_ExchangeChar(cache2, &cache2); /* X  | X  | X  | 0  | B11 | B10 | B9 | B8 */
-  SPI_ExchangeChar(cache3, &cache3); /* B7 | B6 | B5 | B4 | B3  | B2  | B1 | B0 */   
-  SPI0CS = SPI0CS_NULL;    /* deselect any chip */
-  
-  value.s.Hi = cache2 & 0b00001111;
-  value.s.Lo = cache3;
-  value.l = ADC_OFFSET - value.l;
-      
-  Analog_Input[index].Value3 = Analog_Input[index].Value2;  
-  Analog_Input[index].Value2 = Analog_Input[index].Value1;  
-  Analog_Input[index].Value1 = value.l;  
-  Analog_Input[index].OldValue.l = Analog_Input[index].Value.l;
-      
-  Analog_Input[index].Value.l = FindMedianOfThreeNumbers(Analog_Input[index].Value1,
-  															                         Analog_Input[index].Value2,
-  															                         Analog_Input[index].Value3);
+  transaction.chipSelect = SPI0CS_ADC; /* select ADC chip as our listener */
+  transaction.nbBytes = 3;
+  transaction.data[0] = cache1;        /* X  | X  | X  | X  | X   | X   | X  | X  */
+  transaction.data[1] = cache2;        /* X  | X  | X  | 0  | B11 | B10 | B9 | B8 */
+  transaction.data[2] = 0;             /* B7 | B6 | B5 | B4 | B3  | B2  | B1 | B0 */
+  transaction.tag = index;
+  transaction.completionRoutine = &AnalogGetComplete;
+  
+  isQueued = SPI_Post(&transaction);
+  
+  /* conversion is filtered once it has come back, report what changed since last call */
+  *changedPtr = AnalogInputChanged[index];
+  AnalogInputChanged[index] = bFALSE;
   
-  return Analog_Input[index].Value.l != Analog_Input[index].OldValue.l;  
+  return isQueued;
 }
 
 /**
- * \fn void Analog_Put(const TAnalogChannel channelNb, INT16 value)
+ * \fn BOOL Analog_Put(const TAnalogChannel channelNb, INT16 value)
  * \brief Sets an analog output channel's value
  * \param channelNb the number of the analog output channel to write
  * \param value the value of the analog output to write
+ * \return TRUE if the value was queued for the DAC, Analog_Output is left as it is otherwise
  * \warning Assumes that the DAC has been set up   
  */
-void Analog_Put(const TAnalogChannel channelNb, INT16 value) {
+BOOL Analog_Put(const TAnalogChannel channelNb, INT16 value) {
   UINT8 index = 0xFF, cache1 = 0, cache2 = 0;
   TINT16 cache;
+  TSPITransaction transaction;
   
   /* load hardware related data into caches for SPI exchanging */
   /* NOTE: channel enums might not be in numeric order         */
@@ -158,7 +335,7 @@ void Analog_Put(const TAnalogChannel channelNb, INT16 value) {
 #ifndef NO_DEBUG
     DEBUG(__LINE__, ERR_INVALID_ARGUMENT);
 #endif    
-      return;
+      return bFALSE;
       break;
   }
   
@@ -167,13 +344,204 @@ void Analog_Put(const TAnalogChannel channelNb, INT16 value) {
   cache1 = cache1 | (cache.s.Hi & 0b00001111);
   cache2 = cache.s.Lo;
     
-  SPI0CS = SPI0CS_DAC;     /* select DAC chip as our listener */
-  SPI_ExchangeChar(cache1, &cache1); /* A1 | A0 | /PD | /LDAC | D11 | D10 | D9 | D8 */
-  SPI_ExchangeChar(cache2, &cache2); /* D7 | D6 | D5  | D4    | D3  | D2  | D1 | D0 */
-  SPI0CS = SPI0CS_NULL;    /* deselect any chip */
+  transaction.chipSelect = SPI0CS_DAC; /* select DAC chip as our listener */
+  transaction.nbBytes = 2;
+  transaction.data[0] = cache1;        /* A1 | A0 | /PD | /LDAC | D11 | D10 | D9 | D8 */
+  transaction.data[1] = cache2;        /* D7 | D6 | D5  | D4    | D3  | D2  | D1 | D0 */
+  transaction.completionRoutine = (TSPICompletionRoutine) 0x0000;
+  
+  if (!SPI_Post(&transaction))
+  {
+    return bFALSE;
+  }
         
   /* push in our new value */
   Analog_Output[index].OldValue.l = Analog_Output[index].Value.l;      
   Analog_Output[index].Value.l = value;
+  return bTRUE;
 }
 
+/**
+ * \fn UINT8 Analog_PutAll(const UINT8 channelMask, const INT16* const valuePtr)
+ * \brief Loads analog output channels selected by given mask with /LDAC held high,
+ *        then latches them together with the last one
+ * \param channelMask bit n selects analog output channel n+1
+ * \param valuePtr values of the analog outputs to write, indexed by channel
+ * \return mask of channels whose values reach the DAC output, only those are updated in Analog_Output
+ * \warning Assumes that the DAC has been set up   
+ */
+UINT8 Analog_PutAll(const UINT8 channelMask, const INT16* const valuePtr) {
+  static const UINT8 addressLookupTable[NB_OUTPUT_CHANNELS] = { 0b00000000,   /* A1 | A0 */
+                                                                0b01000000,
+                                                                0b10000000,
+                                                                0b11000000 };
+  UINT8 index = 0, lastIndex = 0xFF, queuedMask = 0;
+  TSPITransaction transaction;
+  
+  if (!valuePtr)
+  {
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_INVALID_POINTER);
+#endif    
+    return 0;
+  }
+  
+  /* word of the last selected channel leaves /LDAC low and latches every loaded channel */
+  for (index = 0; index < NB_OUTPUT_CHANNELS; ++index)
+  {
+    if (channelMask & (1 << index))
+    {
+      lastIndex = index;
+    }
+  }
+  
+  for (index = 0; index < NB_OUTPUT_CHANNELS && lastIndex != 0xFF; ++index)
+  {
+    if (channelMask & (1 << index))
+    {
+      transaction.chipSelect = SPI0CS_DAC; /* select DAC chip as our listener */
+      transaction.nbBytes = 2;
+      transaction.data[0] = addressLookupTable[index] | DAC_POWER_UP | ((UINT8)(valuePtr[index] >> 8) & 0b00001111);
+      transaction.data[1] = (UINT8)valuePtr[index];
+      transaction.completionRoutine = (TSPICompletionRoutine) 0x0000;
+      
+      if (index != lastIndex)
+      {
+        transaction.data[0] = transaction.data[0] | DAC_LOAD_ONLY;
+      }
+      
+      /* every word is a transaction of its own, DAC takes it on deselection */
+      if (SPI_Post(&transaction))
+      {
+        queuedMask |= (UINT8)(1 << index);
+      }
+    }
+  }
+  
+  /* without the latching word loaded channels do not reach the output */
+  if (!(queuedMask & (1 << lastIndex)))
+  {
+    queuedMask = 0;
+  }
+  
+  for (index = 0; index < NB_OUTPUT_CHANNELS; ++index)
+  {
+    if (queuedMask & (1 << index))
+    {
+      Analog_Output[index].OldValue.l = Analog_Output[index].Value.l;      
+      Analog_Output[index].Value.l = valuePtr[index];
+    }
+  }
+  
+  return queuedMask;
+}
+
+/**
+ * \fn BOOL Analog_CaptureArm(const UINT8 channelMask, const UINT16 microSeconds, const UINT16 nbSamples, const TAnalogTrigger trigger, const INT16 level, const UINT32 busClk)
+ * \brief Starts sampling selected analog inputs from timer channel 7, capture buffer is filled once trigger has fired
+ * \param channelMask bit n selects analog input channel n+1
+ * \param microSeconds sample period, at least ANALOG_CAPTURE_CHANNEL_PERIOD for every selected channel
+ * \param nbSamples number of samples of every selected channel
+ * \param trigger trigger edge, it is looked for on the lowest selected channel
+ * \param level trigger level
+ * \param busClk the bus clock rate in Hz
+ * \return TRUE if capture has been armed
+ * \warning Assumes that the ADC and timer have been set up
+ */
+BOOL Analog_CaptureArm(const UINT8 channelMask, const UINT16 microSeconds, const UINT16 nbSamples, const TAnalogTrigger trigger, const INT16 level, const UINT32 busClk)
+{
+  TTimerSetup timerCh7 = {
+                           bTRUE,                   /* outputCompare    */
+                           TIMER_OUTPUT_DISCONNECT, /* outputAction     */
+                           TIMER_INPUT_OFF,         /* inputDetection   */
+                           bFALSE,                  /* toggleOnOverflow */
+                           bFALSE,                  /* interruptEnable  */
+                           bFALSE,                  /* pulseAccumulator */
+                           &AnalogCaptureRoutine    /* routine          */
+                         };
+  UINT8 index = 0, nbChannels = 0, triggerIndex = 0xFF, savedCCR;
+  
+  for (index = 0; index < NB_INPUT_CHANNELS; ++index)
+  {
+    if (channelMask & (1 << index))
+    {
+      if (triggerIndex == 0xFF)
+      {
+        triggerIndex = index;
+      }
+      ++nbChannels;
+    }
+  }
+  
+  if (!nbChannels || !nbSamples || (UINT32)nbSamples * nbChannels > ANALOG_CAPTURE_SIZE ||
+      microSeconds < (UINT16)ANALOG_CAPTURE_CHANNEL_PERIOD * nbChannels || microSeconds > ANALOG_CAPTURE_PERIOD_MAXIMUM ||
+      trigger > ANALOG_TRIGGER_FALLING)
+  {
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_INVALID_ARGUMENT);
+#endif
+    return bFALSE;
+  }
+  
+  EnterCritical();
+  
+  if (AnalogCapture.state == ANALOG_CAPTURE_ARMED || AnalogCapture.state == ANALOG_CAPTURE_RUNNING)
+  {
+    ExitCritical();
+    return bFALSE;
+  }
+  
+  AnalogCapture.channelMask = channelMask;
+  AnalogCapture.triggerIndex = triggerIndex;
+  AnalogCapture.trigger = trigger;
+  AnalogCapture.level = level;
+  AnalogCapture.hasLastValue = bFALSE;
+  AnalogCapture.period = (UINT16)(busClk / MATH_1_MEGA * microSeconds);
+  AnalogCapture.length = nbSamples * nbChannels;
+  AnalogCapture.nbSamples = 0;
+  AnalogCapture.nbPending = 0;
+  AnalogCapture.state = (trigger == ANALOG_TRIGGER_OFF) ? ANALOG_CAPTURE_RUNNING : ANALOG_CAPTURE_ARMED;
+  
+  Timer_Init(TIMER_Ch7, &timerCh7);
+  Timer_Set(TIMER_Ch7, AnalogCapture.period);
+  Timer_Enable(TIMER_Ch7, bTRUE);
+  
+  ExitCritical();
+  
+  return bTRUE;
+}
+
+/**
+ * \fn void Analog_CaptureAbort(void)
+ * \brief Stops sampling, capture goes back to idle
+ */
+void Analog_CaptureAbort(void)
+{
+  UINT8 savedCCR;
+  
+  EnterCritical();
+  Timer_Enable(TIMER_Ch7, bFALSE);
+  AnalogCapture.state = ANALOG_CAPTURE_IDLE;
+  ExitCritical();
+}
+
+/**
+ * \fn TAnalogCaptureState Analog_CaptureState(void)
+ * \brief Tells where capture is at
+ * \return capture state
+ */
+TAnalogCaptureState Analog_CaptureState(void)
+{
+  return AnalogCapture.state;
+}
+
+/**
+ * \fn UINT16 Analog_CaptureLength(void)
+ * \brief Tells how many samples are in capture buffer
+ * \return number of samples across all captured channels
+ * \note Samples are only stable once capture has stopped.
+ */
+UINT16 Analog_CaptureLength(void)
+{
+  return AnalogCapture.nbSamples;
+}
@@ -20,6 +20,19 @@
 #define SPI_BAUDRATE CONFIG_SPI_BAUDRATE
 #endif
 
+/**
+ * Capacity of capture buffer in samples, shared by all captured channels
+ */
+#ifndef CONFIG_ANALOG_CAPTURE_SIZE
+#define ANALOG_CAPTURE_SIZE 512 /* fallback plan */
+#warning "ANALOG_CAPTURE_SIZE using fallback setting 512"
+#else
+#define ANALOG_CAPTURE_SIZE CONFIG_ANALOG_CAPTURE_SIZE
+#endif
+
+#define ANALOG_CAPTURE_CHANNEL_PERIOD 50   /* microseconds, shortest sample period every captured channel adds */
+#define ANALOG_CAPTURE_PERIOD_MAXIMUM 2500 /* microseconds, keeps timer compare within 16 bits */
+
 typedef enum
 {
   /* analog interface output channels */
@@ -49,6 +62,22 @@ typedef struct
   TINT16 Value, OldValue;  
 } TAnalogOutput;
 
+typedef enum
+{
+  ANALOG_CAPTURE_IDLE,    /* never armed or aborted */
+  ANALOG_CAPTURE_ARMED,   /* sampling, waiting for trigger */
+  ANALOG_CAPTURE_RUNNING, /* filling capture buffer */
+  ANALOG_CAPTURE_DONE,    /* capture buffer is full */
+  ANALOG_CAPTURE_OVERRUN  /* conversions fell behind sample period, capture buffer is incomplete */
+} TAnalogCaptureState;
+
+typedef enum
+{
+  ANALOG_TRIGGER_OFF,     /* capture starts right away */
+  ANALOG_TRIGGER_RISING,  /* first captured channel crosses trigger level upwards */
+  ANALOG_TRIGGER_FALLING  /* first captured channel crosses trigger level downwards */
+} TAnalogTrigger;
+
 extern TAnalogInput Analog_Input[NB_INPUT_CHANNELS];
 extern TAnalogOutput Analog_Output[NB_OUTPUT_CHANNELS];
 
@@ -60,21 +89,74 @@ extern TAnalogOutput Analog_Output[NB_OUTPUT_CHANNELS];
 void Analog_Setup(const UINT32 busClk);
 
 /**
- * \fn BOOL Analog_Get(const TAnalogChannel channelNb)
+ * \fn BOOL Analog_Get(const TAnalogChannel channelNb, BOOL* const changedPtr)
  * \brief Gets an analog input channel's value 
  * \param channelNb the number of the analog input channel to read
- * \return a Boolean value indicating if the channel reading was changed
+ * \param changedPtr a pointer to store whether the channel reading was changed
+ * \return TRUE if a conversion was queued, FALSE if SPI queue was full and Analog_Input is left as it is
  * \warning Assumes that the ADC has been set up   
  */
-BOOL Analog_Get(const TAnalogChannel channelNb);
+BOOL Analog_Get(const TAnalogChannel channelNb, BOOL* const changedPtr);
 
 /**
- * \fn void Analog_Put(const TAnalogChannel channelNb, INT16 value)
+ * \fn BOOL Analog_Put(const TAnalogChannel channelNb, INT16 value)
  * \brief Sets an analog output channel's value
  * \param channelNb the number of the analog output channel to write
  * \param value the value of the analog output to write
+ * \return TRUE if the value was queued for the DAC, Analog_Output is left as it is otherwise
+ * \warning Assumes that the DAC has been set up   
+ */
+BOOL Analog_Put(const TAnalogChannel channelNb, INT16 value);
+
+/**
+ * \fn UINT8 Analog_PutAll(const UINT8 channelMask, const INT16* const valuePtr)
+ * \brief Loads analog output channels selected by given mask with /LDAC held high,
+ *        then latches them together with the last one
+ * \param channelMask bit n selects analog output channel n+1
+ * \param valuePtr values of the analog outputs to write, indexed by channel
+ * \return mask of channels whose values reach the DAC output, only those are updated in Analog_Output
  * \warning Assumes that the DAC has been set up   
  */
-void Analog_Put(const TAnalogChannel channelNb, INT16 value);
+UINT8 Analog_PutAll(const UINT8 channelMask, const INT16* const valuePtr);
+
+/**
+ * \brief Captured samples, interleaved by channel in channel order, same value convention as Analog_Input
+ */
+extern INT16 Analog_CaptureBuffer[ANALOG_CAPTURE_SIZE];
+
+/**
+ * \fn BOOL Analog_CaptureArm(const UINT8 channelMask, const UINT16 microSeconds, const UINT16 nbSamples, const TAnalogTrigger trigger, const INT16 level, const UINT32 busClk)
+ * \brief Starts sampling selected analog inputs from timer channel 7, capture buffer is filled once trigger has fired
+ * \param channelMask bit n selects analog input channel n+1
+ * \param microSeconds sample period, at least ANALOG_CAPTURE_CHANNEL_PERIOD for every selected channel
+ * \param nbSamples number of samples of every selected channel
+ * \param trigger trigger edge, it is looked for on the lowest selected channel
+ * \param level trigger level
+ * \param busClk the bus clock rate in Hz
+ * \return TRUE if capture has been armed
+ * \warning Assumes that the ADC and timer have been set up
+ */
+BOOL Analog_CaptureArm(const UINT8 channelMask, const UINT16 microSeconds, const UINT16 nbSamples, const TAnalogTrigger trigger, const INT16 level, const UINT32 busClk);
+
+/**
+ * \fn void Analog_CaptureAbort(void)
+ * \brief Stops sampling, capture goes back to idle
+ */
+void Analog_CaptureAbort(void);
+
+/**
+ * \fn TAnalogCaptureState Analog_CaptureState(void)
+ * \brief Tells where capture is at
+ * \return capture state
+ */
+TAnalogCaptureState Analog_CaptureState(void);
+
+/**
+ * \fn UINT16 Analog_CaptureLength(void)
+ * \brief Tells how many samples are in capture buffer
+ * \return number of samples across all captured channels
+ * \note Samples are only stable once capture has stopped.
+ */
+UINT16 Analog_CaptureLength(void);
 
 #endif
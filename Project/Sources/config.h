@@ -41,6 +41,12 @@
 #warning "SPI baudrate override detected!"
 #endif
 
+#ifndef CONFIG_SPI_QUEUE_SIZE
+#define CONFIG_SPI_QUEUE_SIZE 16        /* SPI transactions waiting for the bus, power of two */
+#else
+#warning "SPI queue size override detected!"
+#endif
+
 #ifndef CONFIG_REFCLK
 #define CONFIG_REFCLK 8000000           /* Reference clock in hz */
 #else
@@ -62,7 +68,7 @@
 /* RESERVED END */
 
 #ifndef CONFIG_COP_RATE
-#define CONFIG_COP_RATE COP_RATE_2_14    /* Predefined COP rate */
+#define CONFIG_COP_RATE COP_RATE_2_22    /* Predefined COP rate, 2^22 / OSCCLK = 262 ms outlasts routine thread's longest wait of 2 ticks (131 ms) twice over */
 #else
 #warning "COP rate override detected!"
 #endif
@@ -73,10 +79,58 @@
 #warning "Maximum bus clock override detected!"
 #endif
 
-#ifndef CONFIG_FIFO_SIZE
-#define CONFIG_FIFO_SIZE 256 /* Capacity of FIFO buffer */
+#ifndef CONFIG_SCI_RX_FIFO_SIZE
+#define CONFIG_SCI_RX_FIFO_SIZE 256 /* Capacity of SCI receive FIFO buffer, power of two */
+#else
+#warning "SCI receive FIFO buffer size override detected!"
+#endif
+
+#ifndef CONFIG_SCI_TX_FIFO_SIZE
+#define CONFIG_SCI_TX_FIFO_SIZE 256 /* Capacity of SCI transmit FIFO buffer, power of two */
+#else
+#warning "SCI transmit FIFO buffer size override detected!"
+#endif
+
+#ifndef CONFIG_SCI_TX_BULK_FIFO_SIZE
+#define CONFIG_SCI_TX_BULK_FIFO_SIZE 256 /* Capacity of SCI bulk transmit FIFO buffer, power of two */
+#else
+#warning "SCI bulk transmit FIFO buffer size override detected!"
+#endif
+
+#ifndef CONFIG_ANALOG_CAPTURE_SIZE
+#define CONFIG_ANALOG_CAPTURE_SIZE 512 /* Capacity of analog input capture buffer in samples */
+#else
+#warning "Analog capture buffer size override detected!"
+#endif
+
+#ifndef CONFIG_AWG_CPU_BUDGET
+#define CONFIG_AWG_CPU_BUDGET 500 /* Share of CPU time AWG channels may take, in 1/1000 */
 #else
-#warning "General FIFO buffer size override detected!"
+#warning "AWG CPU budget override detected!"
+#endif
+
+#ifndef CONFIG_AWG_SAMPLE_COST
+#define CONFIG_AWG_SAMPLE_COST 60 /* Estimated microseconds to render and output one AWG sample */
+#else
+#warning "AWG sample cost override detected!"
+#endif
+
+#ifndef CONFIG_PACKET_QUEUE_SIZE
+#define CONFIG_PACKET_QUEUE_SIZE 8 /* Received packets waiting for handling, power of two */
+#else
+#warning "Packet queue size override detected!"
+#endif
+
+#ifndef CONFIG_PACKET_PAYLOAD_SIZE
+#define CONFIG_PACKET_PAYLOAD_SIZE 384 /* Capacity of packet payload buffer */
+#else
+#warning "Packet payload buffer size override detected!"
+#endif
+
+#ifndef CONFIG_PACKET_PAYLOAD_TIMEOUT
+#define CONFIG_PACKET_PAYLOAD_TIMEOUT 2 /* Ticks between two payload bytes before payload is dropped, a full payload takes 33 ms at 115200 */
+#else
+#warning "Packet payload timeout override detected!"
 #endif
 
 
@@ -116,6 +170,12 @@
 #warning "ModCon analog input sampling rate EEPROM address override detected!"
 #endif
 
+#ifndef CONFIG_EEPROM_ADDRESS_MODCON_BAUD_RATE
+#define CONFIG_EEPROM_ADDRESS_MODCON_BAUD_RATE 0x0414 /* 16-bits negotiated baud rate EEPROM address */
+#else
+#warning "ModCon baud rate EEPROM address override detected!"
+#endif
+
 /* RESERVED BEGIN */
 #ifndef CONFIG_EEPROM_ADDRESS_PACKET_PERIOD
 #define CONFIG_EEPROM_ADDRESS_PACKET_PERIOD 0x0412 /* 16-bits Packet period EEPROM address */
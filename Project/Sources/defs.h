@@ -39,7 +39,9 @@
 #define ERR_LCD_SETUP        0xBADB /* LCD initialization failure */
 #define ERR_CRITICAL         0xBADC /* critical error */
 #define ERR_HMI_SETUP        0xBADD /* HMI initialization failure */
+#define ERR_AWG_BUDGET       0xBADE /* AWG channels would exceed CPU budget */
 #define ERR_BAD_FOOD         0xBADF /* 0xBAADF00D if you knew it, you are obsoleted */
+#define ERR_SPI_QUEUE        0xBAE0 /* SPI transaction queue is full */
 #endif
 
 #ifndef UNUSED
@@ -10,6 +10,7 @@
 #include "clock.h"
 #include "EEPROM.h"
 #include "packet.h"
+#include "SCI.h"
 #include "AWG.h"
 #include "OS.h"
 #include "utils.h"
@@ -20,6 +21,7 @@
 
 static UINT8 RoutineStack[THREAD_STACK_SIZE];
 static UINT8 RuntimeIndictorRoutineStack[THREAD_STACK_SIZE];
+static UINT8 AWGRenderRoutineStack[THREAD_STACK_SIZE];
 
 static TAWGChannel AWGChannelLookupTable[4] =
 {
@@ -29,6 +31,52 @@ static TAWGChannel AWGChannelLookupTable[4] =
   AWG_Ch4
 };
 
+typedef struct
+{
+  UINT8 decimation; /* samples per report, 0 turns telemetry off */
+  UINT8 mode;
+  UINT8 count;      /* samples gathered in current window */
+  
+  INT16 minimum, maximum;
+  INT32 sum;
+  
+  INT16 report[2];       /* value, or minimum and maximum */
+  volatile BOOL isReady; /* report is waiting for transmit room */
+  
+} TModConTelemetry;
+
+static TModConTelemetry ModConTelemetry[NB_AWG_CHANNELS] = {0};
+
+typedef struct
+{
+  UINT32 baudRate;      /* rate host is known to talk at */
+  UINT32 trialBaudRate; /* rate waiting for host confirmation, 0 if none */
+  UINT32 deadline;      /* OS time trial rate must be confirmed by */
+  BOOL isOnTrial;       /* link has been switched to trial rate */
+  BOOL isStoredTrial;   /* trial rate was stored in EEPROM, any packet heard at it keeps it */
+  UINT32 lastPacketTime; /* OS time a packet was last taken, framing v2 ends when link stays idle */
+  
+} TModConLink;
+
+static TModConLink ModConLink = {0};
+
+typedef struct
+{
+  UINT8 channelMask;     /* bit n selects analog input channel n+1 */
+  UINT16 samplePeriod;   /* microseconds */
+  UINT16 nbSamples;      /* samples of every channel */
+  TAnalogTrigger trigger;
+  INT16 level;
+  
+  UINT16 nbSent;         /* captured samples streamed out so far */
+  BOOL isReported;       /* end of last capture has been sent */
+  
+} TModConCapture;
+
+static TModConCapture ModConCapture = { 0x01, 1000, 256, ANALOG_TRIGGER_OFF, 0, 0, bTRUE };
+
+static OS_ECB* RoutineSemaphorePtr = (OS_ECB*) 0x0000;
+
 void RuntimeIndictorRoutine(void* dataPtr);
 
 /**
@@ -58,11 +106,12 @@ BOOL HandleModConSpecialVersion(void);
 BOOL HandleModConProtocolModeGet(void);
 
 /**
- * \fn BOOL HandleModConProtocolModeSet(void)
+ * \fn BOOL HandleModConProtocolModeSet(const TPacket* const packetPtr)
  * \brief
+ * \param packetPtr a pointer to received packet
  * \return TRUE if the command has been executed successfully.
  */
-BOOL HandleModConProtocolModeSet(void);
+BOOL HandleModConProtocolModeSet(const TPacket* const packetPtr);
 
 /**
  * \fn BOOL HandleModConNumberGet(void)
@@ -72,11 +121,12 @@ BOOL HandleModConProtocolModeSet(void);
 BOOL HandleModConNumberGet(void);
 
 /**
- * \fn BOOL HandleModConNumberSet(void)
+ * \fn BOOL HandleModConNumberSet(const TPacket* const packetPtr)
  * \brief Assign new value to ModCon number through given packet then update stored EEPROM value. 
+ * \param packetPtr a pointer to received packet
  * \return TRUE if write new value to EEPROM is successful.
  */
-BOOL HandleModConNumberSet(void);
+BOOL HandleModConNumberSet(const TPacket* const packetPtr);
 
 /**
  * \fn BOOL HandleModConModeGet(void)
@@ -86,11 +136,56 @@ BOOL HandleModConNumberSet(void);
 BOOL HandleModConModeGet(void);
 
 /**
- * \fn BOOL HandleModConModeSet(void)
+ * \fn BOOL HandleModConModeSet(const TPacket* const packetPtr)
  * \brief Assign new value to ModCon mode through given packet then update stored EEPROM value. 
+ * \param packetPtr a pointer to received packet
  * \return TRUE if write new value to EEPROM is successful.
  */
-BOOL HandleModConModeSet(void);
+BOOL HandleModConModeSet(const TPacket* const packetPtr);
+
+/**
+ * \fn BOOL HandleModConBaudRateGet(void)
+ * \brief Builds a packet that contains current baud rate and places it into transmit buffer. 
+ * \return TRUE if the packet was queued for transmission successfully.
+ */
+BOOL HandleModConBaudRateGet(void);
+
+/**
+ * \fn BOOL HandleModConBaudRateSet(const TPacket* const packetPtr)
+ * \brief Starts a trial of given baud rate once the answer has been sent at current one.
+ * \param packetPtr a pointer to received packet
+ * \return TRUE if the baud rate can be reached and no other trial is going on.
+ */
+BOOL HandleModConBaudRateSet(const TPacket* const packetPtr);
+
+/**
+ * \fn BOOL HandleModConBaudRateConfirm(const TPacket* const packetPtr)
+ * \brief Keeps trial baud rate, and stores it in EEPROM if asked.
+ * \param packetPtr a pointer to received packet
+ * \return TRUE if a trial was going on and it has been kept.
+ */
+BOOL HandleModConBaudRateConfirm(const TPacket* const packetPtr);
+
+/**
+ * \fn BOOL HandleModConFramingGet(void)
+ * \brief Builds a packet that contains packet framing and places it into transmit buffer.
+ * \return TRUE if the packet was queued for transmission successfully.
+ */
+BOOL HandleModConFramingGet(void);
+
+/**
+ * \fn void ServiceModConLink(void)
+ * \brief Switches to trial baud rate once transmitter is idle, and falls back if it is not confirmed in time.
+ *        Falls back to framing v1 as well once link has been idle in framing v2 for too long.
+ */
+void ServiceModConLink(void);
+
+/**
+ * \fn BOOL SendModConStartup(void)
+ * \brief Builds packets of ModCon startup figures and places them into transmit buffer. 
+ * \return TRUE if packets were queued for transmission successfully.
+ */  
+BOOL SendModConStartup(void);
 
 /**
  * \fn void TurnOnStartupIndicator(void)
@@ -104,46 +199,80 @@ void TurnOnStartupIndicator(void);
  */
 void SampleAnalogChannels(void);
 
-//void AWGPostProcessRoutine(TAWGChannel channelNb);
+/**
+ * \fn void AWGPostProcessRoutine(TAWGChannel channelNb)
+ * \brief Gathers AWG channel value into its telemetry window
+ * \param channelNb AWG channel number
+ */
+void AWGPostProcessRoutine(TAWGChannel channelNb);
+
+/**
+ * \fn void SendModConTelemetry(void)
+ * \brief Sends finished telemetry reports as long as transmit room is left for command responses
+ */
+void SendModConTelemetry(void);
+
+/**
+ * \fn void SendModConCapture(void)
+ * \brief Streams a stopped capture out in blocks as long as bulk transmit room is left, then reports how it ended
+ */
+void SendModConCapture(void);
+
+/**
+ * \fn void WakeRoutine(void)
+ * \brief Wakes up routine thread, safe to call from interrupts
+ */
+void WakeRoutine(void);
 
 /**
- * \fn BOOL HandleModConStartup(void)
+ * \fn BOOL HandleModConStartup(const TPacket* const packetPtr)
  * \brief Builds packets that are necessary for startup information and places them into transmit buffer. 
+ * \param packetPtr a pointer to received packet
  * \return TRUE if packets were queued for transmission successfully.
  */  
-BOOL HandleModConStartup(void) 
+BOOL HandleModConStartup(const TPacket* const packetPtr) 
 {
   /* it should contain zeros */
-  if (!Packet_Parameter1 && !Packet_Parameter23)
+  if (!Packet_Parameter1Of(packetPtr) && !Packet_Parameter23Of(packetPtr))
   {    
-    /* push packets of ModCon startup figures */                    
-    if (!Packet_Put(MODCON_COMMAND_STARTUP, 0, 0, 0))
-    {
+    return SendModConStartup();
+  }
+  return bFALSE;    
+}
+
+/**
+ * \fn BOOL SendModConStartup(void)
+ * \brief Builds packets of ModCon startup figures and places them into transmit buffer. 
+ * \return TRUE if packets were queued for transmission successfully.
+ */  
+BOOL SendModConStartup(void) 
+{
+  if (!Packet_Put(MODCON_COMMAND_STARTUP, 0, 0, 0))
+  {
 #ifndef NO_DEBUG
-      DEBUG(__LINE__, ERR_PACKET_PUT);
+    DEBUG(__LINE__, ERR_PACKET_PUT);
 #endif
-      return bFALSE;    
-    }
-    return HandleModConSpecialVersion() &&
-           HandleModConProtocolModeGet() &&
-           HandleModConNumberGet() &&
-           HandleModConModeGet();
+    return bFALSE;    
   }
-  return bFALSE;    
+  return HandleModConSpecialVersion() &&
+         HandleModConProtocolModeGet() &&
+         HandleModConNumberGet() &&
+         HandleModConModeGet();
 }
 
 /**
- * \fn BOOL HandleModConSpecial(void)
+ * \fn BOOL HandleModConSpecial(const TPacket* const packetPtr)
  * \brief response to ModCon special commands. 
+ * \param packetPtr a pointer to received packet
  * \return TRUE if the command has been executed successfully.
  */
-BOOL HandleModConSpecial(void)
+BOOL HandleModConSpecial(const TPacket* const packetPtr)
 {
-  if (Packet_Parameter1 == MODCON_DEBUG_INITIAL && Packet_Parameter2 == MODCON_DEBUG_TOKEN && Packet_Parameter3 == CONTROL_CR)
+  if (Packet_Parameter1Of(packetPtr) == MODCON_DEBUG_INITIAL && Packet_Parameter2Of(packetPtr) == MODCON_DEBUG_TOKEN && Packet_Parameter3Of(packetPtr) == CONTROL_CR)
   {                    
     return HandleModConSpecialDebug();
   }
-  if (Packet_Parameter1 == MODCON_VERSION_INITIAL && Packet_Parameter2 == MODCON_VERSION_TOKEN && Packet_Parameter3 == CONTROL_CR)
+  if (Packet_Parameter1Of(packetPtr) == MODCON_VERSION_INITIAL && Packet_Parameter2Of(packetPtr) == MODCON_VERSION_TOKEN && Packet_Parameter3Of(packetPtr) == CONTROL_CR)
   {                    
     return HandleModConSpecialVersion();
   }
@@ -185,26 +314,27 @@ BOOL HandleModConSpecialVersion(void)
 }
 
 /**
- * \fn BOOL HandleModConProtocolMode(void)
+ * \fn BOOL HandleModConProtocolMode(const TPacket* const packetPtr)
  * \brief response to ModCon protocol commands. 
+ * \param packetPtr a pointer to received packet
  * \return TRUE if the command has been executed successfully.
  */
-BOOL HandleModConProtocolMode(void)
+BOOL HandleModConProtocolMode(const TPacket* const packetPtr)
 {
   /* parameter3 is not acceptable */    
-  if (!Packet_Parameter3)
+  if (!Packet_Parameter3Of(packetPtr))
   {    
-    switch(Packet_Parameter1)
+    switch(Packet_Parameter1Of(packetPtr))
     {
       case MODCON_PROTOCOL_MODE_GET:
         /* when get parameter2 is not acceptable */    
-        if (!Packet_Parameter2)
+        if (!Packet_Parameter2Of(packetPtr))
         {
           return HandleModConProtocolModeGet();
         }
         break;
       case MODCON_PROTOCOL_MODE_SET:
-        return HandleModConProtocolModeSet();
+        return HandleModConProtocolModeSet(packetPtr);
         break;
       default:
         break;
@@ -231,15 +361,16 @@ BOOL HandleModConProtocolModeGet(void)
 }
 
 /**
- * \fn BOOL HandleModConProtocolModeSet(void)
+ * \fn BOOL HandleModConProtocolModeSet(const TPacket* const packetPtr)
  * \brief Assign new value to ModCon protocol mode through given packet by updating stored EEPROM value.
+ * \param packetPtr a pointer to received packet
  * \return TRUE if write new value to EEPROM is successful.
  */
-BOOL HandleModConProtocolModeSet(void)
+BOOL HandleModConProtocolModeSet(const TPacket* const packetPtr)
 {
-  if (Packet_Parameter2 == MODCON_PROTOCOL_MODE_ASYNCHRONOUS || Packet_Parameter2 == MODCON_PROTOCOL_MODE_SYNCHRONOUS)
+  if (Packet_Parameter2Of(packetPtr) == MODCON_PROTOCOL_MODE_ASYNCHRONOUS || Packet_Parameter2Of(packetPtr) == MODCON_PROTOCOL_MODE_SYNCHRONOUS)
   {
-    if (!EEPROM_Write16(&ModConProtocolMode, (UINT16)Packet_Parameter2))
+    if (!EEPROM_Write16(&ModConProtocolMode, (UINT16)Packet_Parameter2Of(packetPtr)))
     {
 #ifndef NO_DEBUG
       DEBUG(__LINE__, ERR_EEPROM_WRITE);          
@@ -254,23 +385,24 @@ BOOL HandleModConProtocolModeSet(void)
 }
 
 /**
- * \fn BOOL HandleModConNumber(void)
+ * \fn BOOL HandleModConNumber(const TPacket* const packetPtr)
  * \brief response to ModCon number commands. 
+ * \param packetPtr a pointer to received packet
  * \return TRUE if the command has been executed successfully.
  */
-BOOL HandleModConNumber(void)
+BOOL HandleModConNumber(const TPacket* const packetPtr)
 {
-  switch(Packet_Parameter1)
+  switch(Packet_Parameter1Of(packetPtr))
   {
     case MODCON_NUMBER_GET:
       /* when get parameter2 and 3 is not acceptable */		      
-      if (!Packet_Parameter23)
+      if (!Packet_Parameter23Of(packetPtr))
       {        
         return HandleModConNumberGet();
       }
       break;
     case MODCON_NUMBER_SET:
-      return HandleModConNumberSet();
+      return HandleModConNumberSet(packetPtr);
       break;
     default:
       break;
@@ -299,13 +431,14 @@ BOOL HandleModConNumberGet(void)
 }
 
 /**
- * \fn BOOL HandleModConNumberSet(void)
+ * \fn BOOL HandleModConNumberSet(const TPacket* const packetPtr)
  * \brief Assign new value to ModCon number through given packet by updating stored EEPROM value. 
+ * \param packetPtr a pointer to received packet
  * \return TRUE if write new value to EEPROM is successful.
  */
-BOOL HandleModConNumberSet(void)
+BOOL HandleModConNumberSet(const TPacket* const packetPtr)
 {
-  if (!EEPROM_Write16(&ModConNumber, Packet_Parameter23))
+  if (!EEPROM_Write16(&ModConNumber, Packet_Parameter23Of(packetPtr)))
   {
 #ifndef NO_DEBUG
     DEBUG(__LINE__, ERR_EEPROM_WRITE);          
@@ -326,7 +459,7 @@ BOOL HandleModConUptime(void)
 
   if (seconds != Clock_Seconds)
   {    
-    if (!Packet_Put(MODCON_COMMAND_TIME, MODCON_TIME_INITIAL, Clock_Seconds, Clock_Minutes)) 
+    if (!Packet_PutBulk(MODCON_COMMAND_TIME, MODCON_TIME_INITIAL, Clock_Seconds, Clock_Minutes)) 
     {
 #ifndef NO_DEBUG
       DEBUG(__LINE__, ERR_PACKET_PUT);
@@ -339,23 +472,24 @@ BOOL HandleModConUptime(void)
 }
 
 /**
- * \fn BOOL HandleModConMode(void)
+ * \fn BOOL HandleModConMode(const TPacket* const packetPtr)
  * \brief response to ModCon mode commands. 
+ * \param packetPtr a pointer to received packet
  * \return TRUE if the command has been executed successfully.
  */
-BOOL HandleModConMode(void)
+BOOL HandleModConMode(const TPacket* const packetPtr)
 {
-	switch(Packet_Parameter1)
+	switch(Packet_Parameter1Of(packetPtr))
 	{
 		case MODCON_MODE_GET:
       /* when get parameter2 and 3 is not acceptable */		      
-		  if (!Packet_Parameter23)
+		  if (!Packet_Parameter23Of(packetPtr))
 		  {		      
 		    return HandleModConModeGet();
 		  }
 		  break;
 		case MODCON_MODE_SET:
-      return HandleModConModeSet();
+      return HandleModConModeSet(packetPtr);
 		  break;
 		default:
 		  break;
@@ -384,13 +518,14 @@ BOOL HandleModConModeGet(void)
 }
 
 /**
- * \fn BOOL HandleModConModeSet(void)
+ * \fn BOOL HandleModConModeSet(const TPacket* const packetPtr)
  * \brief Assign new value to ModCon mode through given packet then update stored EEPROM value. 
+ * \param packetPtr a pointer to received packet
  * \return TRUE if write new value to EEPROM is successful.
  */
-BOOL HandleModConModeSet(void)
+BOOL HandleModConModeSet(const TPacket* const packetPtr)
 {
-  if (!EEPROM_Write16(&ModConMode, Packet_Parameter23))
+  if (!EEPROM_Write16(&ModConMode, Packet_Parameter23Of(packetPtr)))
   {
 #ifndef NO_DEBUG
     DEBUG(__LINE__, ERR_EEPROM_WRITE);          
@@ -400,6 +535,251 @@ BOOL HandleModConModeSet(void)
   return bTRUE;
 }
 
+/**
+ * \fn BOOL HandleModConBaudRate(const TPacket* const packetPtr)
+ * \brief response to ModCon baud rate commands. 
+ * \param packetPtr a pointer to received packet
+ * \return TRUE if the command has been executed successfully.
+ */
+BOOL HandleModConBaudRate(const TPacket* const packetPtr)
+{
+  switch(Packet_Parameter1Of(packetPtr))
+  {
+    case MODCON_BAUD_RATE_GET:
+      /* when get parameter2 and 3 is not acceptable */		      
+      if (!Packet_Parameter23Of(packetPtr))
+      {        
+        return HandleModConBaudRateGet();
+      }
+      break;
+    case MODCON_BAUD_RATE_SET:
+      return HandleModConBaudRateSet(packetPtr);
+      break;
+    case MODCON_BAUD_RATE_CONFIRM:
+      /* parameter2 tells whether to keep it over reset, parameter3 is not acceptable */
+      if (Packet_Parameter2Of(packetPtr) <= 1 && !Packet_Parameter3Of(packetPtr))
+      {
+        return HandleModConBaudRateConfirm(packetPtr);
+      }
+      break;
+    default:
+      break;
+  }
+  return bFALSE;
+}
+
+/**
+ * \fn BOOL HandleModConBaudRateGet(void)
+ * \brief Builds a packet that contains current baud rate and places it into transmit buffer. 
+ * \return TRUE if the packet was queued for transmission successfully.
+ */
+BOOL HandleModConBaudRateGet(void)
+{
+  TUINT16 baudRate;
+  
+  baudRate.l = (UINT16)((ModConLink.isOnTrial ? ModConLink.trialBaudRate : ModConLink.baudRate) / MODCON_BAUD_RATE_UNIT);
+  if (!Packet_Put(MODCON_COMMAND_BAUD_RATE, MODCON_BAUD_RATE_GET, baudRate.s.Lo, baudRate.s.Hi))
+  {
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_PACKET_PUT);
+#endif
+    return bFALSE;
+  }
+  return bTRUE;
+}
+
+/**
+ * \fn BOOL HandleModConBaudRateSet(const TPacket* const packetPtr)
+ * \brief Starts a trial of given baud rate once the answer has been sent at current one.
+ * \param packetPtr a pointer to received packet
+ * \return TRUE if the baud rate can be reached and no other trial is going on.
+ */
+BOOL HandleModConBaudRateSet(const TPacket* const packetPtr)
+{
+  UINT32 baudRate = (UINT32)Packet_Parameter23Of(packetPtr) * MODCON_BAUD_RATE_UNIT;
+  
+  if (ModConLink.trialBaudRate || !SCI_BaudRateDivisor(baudRate, CONFIG_BUSCLK))
+  {
+    return bFALSE;
+  }
+  
+  /* echo goes out at current rate, ServiceModConLink switches after it */
+  if (!Packet_Put(MODCON_COMMAND_BAUD_RATE, MODCON_BAUD_RATE_SET, Packet_Parameter2Of(packetPtr), Packet_Parameter3Of(packetPtr)))
+  {
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_PACKET_PUT);
+#endif
+    return bFALSE;
+  }
+  
+  ModConLink.isOnTrial = bFALSE;
+  ModConLink.trialBaudRate = baudRate;
+  return bTRUE;
+}
+
+/**
+ * \fn BOOL HandleModConBaudRateConfirm(const TPacket* const packetPtr)
+ * \brief Keeps trial baud rate, and stores it in EEPROM if asked.
+ * \param packetPtr a pointer to received packet
+ * \return TRUE if a trial was going on and it has been kept.
+ */
+BOOL HandleModConBaudRateConfirm(const TPacket* const packetPtr)
+{
+  /* a confirmation can only have been heard at trial rate */
+  if (!ModConLink.isOnTrial)
+  {
+    return bFALSE;
+  }
+  
+  ModConLink.baudRate = ModConLink.trialBaudRate;
+  ModConLink.trialBaudRate = 0;
+  ModConLink.isOnTrial = bFALSE;
+  ModConLink.isStoredTrial = bFALSE;
+  
+  if (Packet_Parameter2Of(packetPtr))
+  {
+    if (!EEPROM_Write16(&ModConBaudRate, (UINT16)(ModConLink.baudRate / MODCON_BAUD_RATE_UNIT)))
+    {
+#ifndef NO_DEBUG
+      DEBUG(__LINE__, ERR_EEPROM_WRITE);          
+#endif
+      return bFALSE;
+    }
+  }
+  
+  /* send back current baud rate to confirm */
+  UNUSED(HandleModConBaudRateGet());
+  return bTRUE;
+}
+
+/**
+ * \fn void ServiceModConLink(void)
+ * \brief Switches to trial baud rate once transmitter is idle, and falls back if it is not confirmed in time.
+ *        Falls back to framing v1 as well once link has been idle in framing v2 for too long.
+ */
+void ServiceModConLink(void)
+{
+  /* a host that only knows framing v1 can not switch back itself, it is heard again after a quiet spell */
+  if (Packet_GetFraming() == PACKET_FRAMING_V2 && (INT32)(OS_TimeGet() - ModConLink.lastPacketTime) >= MODCON_FRAMING_IDLE_TICKS)
+  {
+    Packet_SetFraming(PACKET_FRAMING_V1);
+  }
+  
+  /* baud rate is only touched between frames */
+  if (!ModConLink.trialBaudRate || !SCI_OutIdle())
+  {
+    return;
+  }
+  
+  if (!ModConLink.isOnTrial)
+  {
+    UNUSED(SCI_SetBaudRate(ModConLink.trialBaudRate, CONFIG_BUSCLK));
+    ModConLink.deadline = OS_TimeGet() + (ModConLink.isStoredTrial ? MODCON_BAUD_RATE_STORED_TICKS : MODCON_BAUD_RATE_CONFIRM_TICKS);
+    ModConLink.isOnTrial = bTRUE;
+  }
+  else if ((INT32)(OS_TimeGet() - ModConLink.deadline) >= 0)
+  {
+    /* host has not made it to trial rate, go back to the one it knows */
+    UNUSED(SCI_SetBaudRate(ModConLink.baudRate, CONFIG_BUSCLK));
+    ModConLink.trialBaudRate = 0;
+    ModConLink.isOnTrial = bFALSE;
+    ModConLink.isStoredTrial = bFALSE;
+  }
+}
+
+/**
+ * \fn BOOL HandleModConFraming(const TPacket* const packetPtr)
+ * \brief response to ModCon framing commands. 
+ * \param packetPtr a pointer to received packet
+ * \return TRUE if the command has been executed successfully.
+ */
+BOOL HandleModConFraming(const TPacket* const packetPtr)
+{
+  /* parameter3 is not acceptable */    
+  if (!Packet_Parameter3Of(packetPtr))
+  {    
+    switch(Packet_Parameter1Of(packetPtr))
+    {
+      case MODCON_FRAMING_GET:
+        if (!Packet_Parameter2Of(packetPtr))
+        {
+          return HandleModConFramingGet();
+        }
+        break;
+      case MODCON_FRAMING_SET:
+        if (Packet_Parameter2Of(packetPtr) == MODCON_FRAMING_V1 || Packet_Parameter2Of(packetPtr) == MODCON_FRAMING_V2)
+        {
+          /* answer and ACK still go out in current framing, new one starts with next packet */
+          Packet_SetFraming((Packet_Parameter2Of(packetPtr) == MODCON_FRAMING_V2) ? PACKET_FRAMING_V2 : PACKET_FRAMING_V1);
+          UNUSED(HandleModConFramingGet());
+          return bTRUE;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  return bFALSE;
+}
+
+/**
+ * \fn BOOL HandleModConFramingGet(void)
+ * \brief Builds a packet that contains packet framing and places it into transmit buffer.
+ * \return TRUE if the packet was queued for transmission successfully.
+ */
+BOOL HandleModConFramingGet(void)
+{
+  UINT8 framing = (Packet_GetFraming() == PACKET_FRAMING_V2) ? MODCON_FRAMING_V2 : MODCON_FRAMING_V1;
+  
+  if (!Packet_Put(MODCON_COMMAND_FRAMING, MODCON_FRAMING_GET, framing, 0))
+  {
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_PACKET_PUT);
+#endif
+    return bFALSE;
+  }
+  return bTRUE;
+}
+
+/**
+ * \fn BOOL HandleModConTxDrops(const TPacket* const packetPtr)
+ * \brief response to ModCon transmit drops commands. 
+ * \param packetPtr a pointer to received packet
+ * \return TRUE if the command has been executed successfully.
+ */
+BOOL HandleModConTxDrops(const TPacket* const packetPtr)
+{
+  TUINT16 count;
+  
+  /* parameter2 and parameter3 are not acceptable */    
+  if (Packet_Parameter2Of(packetPtr) || Packet_Parameter3Of(packetPtr))
+  {
+    return bFALSE;
+  }
+  
+  switch(Packet_Parameter1Of(packetPtr))
+  {
+    case MODCON_TX_DROPS_CONTROL:
+      count.l = SCI_OutDropped(SCI_TX_CONTROL);
+      break;
+    case MODCON_TX_DROPS_BULK:
+      count.l = SCI_OutDropped(SCI_TX_BULK);
+      break;
+    default:
+      return bFALSE;
+      break;
+  }
+  
+  if (!Packet_Put(MODCON_COMMAND_TX_DROPS, Packet_Parameter1Of(packetPtr), count.s.Lo, count.s.Hi))
+  {
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_PACKET_PUT);
+#endif
+    return bFALSE;
+  }
+  return bTRUE;
+}
+
 BOOL HandleModConAnalogValue(const TAnalogChannel channelNb)
 {
   switch(channelNb)
@@ -470,7 +850,7 @@ BOOL HandleModConAnalogInputValue(const TAnalogChannel channelNb)
       break;
   }
   
-  if (!Packet_Put(MODCON_COMMAND_ANALOG_INPUT_VALUE, index, Analog_Input[index].Value.s.Lo, Analog_Input[index].Value.s.Hi))
+  if (!Packet_PutBulk(MODCON_COMMAND_ANALOG_INPUT_VALUE, index, Analog_Input[index].Value.s.Lo, Analog_Input[index].Value.s.Hi))
   {
 #ifndef NO_DEBUG
     DEBUG(__LINE__, ERR_PACKET_PUT);
@@ -510,7 +890,7 @@ BOOL HandleModConAnalogOutputValue(const TAnalogChannel channelNb)
   
   value.l = 0x07FF - Analog_Output[index].Value.l;
   
-  if (!Packet_Put(MODCON_COMMAND_ANALOG_OUTPUT_VALUE, index, value.s.Lo, value.s.Hi))
+  if (!Packet_PutBulk(MODCON_COMMAND_ANALOG_OUTPUT_VALUE, index, value.s.Lo, value.s.Hi))
   {
 #ifndef NO_DEBUG
     DEBUG(__LINE__, ERR_PACKET_PUT);
@@ -521,19 +901,20 @@ BOOL HandleModConAnalogOutputValue(const TAnalogChannel channelNb)
 }
 
 /**
- * \fn BOOL HandleModConEEPROMProgram(void)
+ * \fn BOOL HandleModConEEPROMProgram(const TPacket* const packetPtr)
  * \brief Program a byte in EEPROM by given address.
+ * \param packetPtr a pointer to received packet
  * \return TRUE if EEPROM program successfully. 
  */
-BOOL HandleModConEEPROMProgram(void)
+BOOL HandleModConEEPROMProgram(const TPacket* const packetPtr)
 { 
-  UINT8 volatile * const address = (UINT8 volatile *)Packet_Parameter12;
+  UINT8 volatile * const address = (UINT8 volatile *)Packet_Parameter12Of(packetPtr);
     
   if ((UINT16)address >= MODCON_EEPROM_ADDRESS_BEGIN && (UINT16)address <= MODCON_EEPROM_ADDRESS_END)
   {    
     if (address != (UINT8 volatile * const)MODCON_EEPROM_ADDRESS_END)
     {
-      if (!EEPROM_Write8(address, Packet_Parameter3))
+      if (!EEPROM_Write8(address, Packet_Parameter3Of(packetPtr)))
       {
 #ifndef NO_DEBUG
         DEBUG(__LINE__, ERR_EEPROM_WRITE);
@@ -555,17 +936,18 @@ BOOL HandleModConEEPROMProgram(void)
 }
 
 /**
- * \fn BOOL HandleModConEEPROMGet(void)
+ * \fn BOOL HandleModConEEPROMGet(const TPacket* const packetPtr)
  * \brief Return byte value of given EEPROM address.
+ * \param packetPtr a pointer to received packet
  * \return TRUE if address is validated and the packet was queued for transmission successfully.
  */
-BOOL HandleModConEEPROMGet(void)
+BOOL HandleModConEEPROMGet(const TPacket* const packetPtr)
 {
-  UINT8 volatile * const address = (UINT8 volatile *)Packet_Parameter12;
+  UINT8 volatile * const address = (UINT8 volatile *)Packet_Parameter12Of(packetPtr);
   
-  if (!Packet_Parameter3 && EEPROM_ValidateAddress((void * const)address))
+  if (!Packet_Parameter3Of(packetPtr) && EEPROM_ValidateAddress((void * const)address))
   { 
-    if (!Packet_Put(MODCON_COMMAND_EEPROM_GET, Packet_Parameter1, Packet_Parameter2, *address))
+    if (!Packet_Put(MODCON_COMMAND_EEPROM_GET, Packet_Parameter1Of(packetPtr), Packet_Parameter2Of(packetPtr), *address))
     {
 #ifndef NO_DEBUG
       DEBUG(__LINE__, ERR_PACKET_PUT);
@@ -578,17 +960,24 @@ BOOL HandleModConEEPROMGet(void)
 }
 
 BOOL HandleModConWaveGetStatus(void);
-BOOL HandleModConWaveSetWaveform(void);
-BOOL HandleModConWaveSetFrequency(void);
-BOOL HandleModConWaveSetAmplitude(void);
-BOOL HandleModConWaveSetOffset(void);
+BOOL HandleModConWaveSetWaveform(const TPacket* const packetPtr);
+BOOL HandleModConWaveSetFrequency(const TPacket* const packetPtr);
+BOOL HandleModConWaveSetAmplitude(const TPacket* const packetPtr);
+BOOL HandleModConWaveSetOffset(const TPacket* const packetPtr);
 BOOL HandleModConWaveEnable(BOOL enable);
+BOOL HandleModConWaveGetUnderrun(void);
+BOOL HandleModConWaveSetArbitrarySlot(const TPacket* const packetPtr);
+BOOL HandleModConWaveSetSamplePeriod(const TPacket* const packetPtr);
+BOOL HandleModConWaveSetNoiseType(const TPacket* const packetPtr);
+BOOL HandleModConWaveSetUpdateMode(const TPacket* const packetPtr);
+BOOL HandleModConWaveSetTelemetry(const TPacket* const packetPtr);
 
 /**
- * \fn BOOL HandleModConWaveActiveChannel(void)
+ * \fn BOOL HandleModConWaveActiveChannel(const TPacket* const packetPtr)
  * \brief Activates selected AWG channel to response to incoming settings
+ * \param packetPtr a pointer to received packet
  */
-BOOL HandleModConWaveActiveChannel(void);
+BOOL HandleModConWaveActiveChannel(const TPacket* const packetPtr);
 
 /**
  * \fn BOOL HandleModConWaveArbitraryPhasor(void)
@@ -597,60 +986,95 @@ BOOL HandleModConWaveActiveChannel(void);
 BOOL HandleModConWaveArbitraryPhasor(void);
 
 /**
- * \fn BOOL HandleModConWave(void)
+ * \fn BOOL HandleModConWave(const TPacket* const packetPtr)
  * \brief Hub of ModCon wave command 
+ * \param packetPtr a pointer to received packet
  */
-BOOL HandleModConWave(void)
+BOOL HandleModConWave(const TPacket* const packetPtr)
 {
-  switch(Packet_Parameter1)
+  switch(Packet_Parameter1Of(packetPtr))
   {
     case MODCON_WAVE_STATUS:
-      if (Packet_Parameter23 == 0)
+      if (Packet_Parameter23Of(packetPtr) == 0)
       {
         return HandleModConWaveGetStatus();
       }
       break;
     case MODCON_WAVE_WAVEFORM:
-      if (Packet_Parameter2 < 6 && Packet_Parameter3 == 0)
+      if (Packet_Parameter2Of(packetPtr) < 6 && Packet_Parameter3Of(packetPtr) == 0)
       {
-        return HandleModConWaveSetWaveform();
+        return HandleModConWaveSetWaveform(packetPtr);
       }
       break;
     case MODCON_WAVE_FREQUENCY:
-      return HandleModConWaveSetFrequency();
+      return HandleModConWaveSetFrequency(packetPtr);
       break;
     case MODCON_WAVE_AMPLITUDE:
-      return HandleModConWaveSetAmplitude();
+      return HandleModConWaveSetAmplitude(packetPtr);
       break;
     case MODCON_WAVE_OFFSET:
-      return HandleModConWaveSetOffset();
+      return HandleModConWaveSetOffset(packetPtr);
       break;
     case MODCON_WAVE_ON:
-      if (Packet_Parameter23 == 0)
+      if (Packet_Parameter23Of(packetPtr) == 0)
       {
         return HandleModConWaveEnable(bTRUE);
       }
       break;
     case MODCON_WAVE_OFF:
-      if (Packet_Parameter23 == 0)
+      if (Packet_Parameter23Of(packetPtr) == 0)
       {
         return HandleModConWaveEnable(bFALSE);
       }
       break;
     case MODCON_WAVE_ACTIVE_CHANNEL:
-      if (Packet_Parameter3 == 0)
+      if (Packet_Parameter3Of(packetPtr) == 0)
       {
-        return HandleModConWaveActiveChannel();
+        return HandleModConWaveActiveChannel(packetPtr);
       }
       break;    
+    case MODCON_WAVE_UNDERRUN:
+      if (Packet_Parameter23Of(packetPtr) == 0)
+      {
+        return HandleModConWaveGetUnderrun();
+      }
+      break;
+    case MODCON_WAVE_ARBITRARY_SLOT:
+      if (Packet_Parameter2Of(packetPtr) < AWG_NB_WAVE_SLOTS && Packet_Parameter3Of(packetPtr) == 0)
+      {
+        return HandleModConWaveSetArbitrarySlot(packetPtr);
+      }
+      break;
+    case MODCON_WAVE_SAMPLE_PERIOD:
+      return HandleModConWaveSetSamplePeriod(packetPtr);
+      break;
+    case MODCON_WAVE_NOISE_TYPE:
+      if (Packet_Parameter2Of(packetPtr) < 2 && Packet_Parameter3Of(packetPtr) == 0)
+      {
+        return HandleModConWaveSetNoiseType(packetPtr);
+      }
+      break;
+    case MODCON_WAVE_UPDATE_MODE:
+      if (Packet_Parameter2Of(packetPtr) < 2 && Packet_Parameter3Of(packetPtr) == 0)
+      {
+        return HandleModConWaveSetUpdateMode(packetPtr);
+      }
+      break;
+    case MODCON_WAVE_TELEMETRY:
+      if (Packet_Parameter3Of(packetPtr) <= MODCON_TELEMETRY_RANGE)
+      {
+        return HandleModConWaveSetTelemetry(packetPtr);
+      }
+      break;
     default:
       break;
   }
 }
 
 /**
- * \fn BOOL HandleModConWaveSetWaveform(void)
+ * \fn BOOL HandleModConWaveGetStatus(void)
  * \brief Sends status of active AWG channel 
+ * \return TRUE if the packets were queued for transmission successfully.
  */
 BOOL HandleModConWaveGetStatus(void)
 {
@@ -707,10 +1131,11 @@ BOOL HandleModConWaveGetStatus(void)
 }
 
 /**
- * \fn BOOL HandleModConWaveSetWaveform(void)
+ * \fn BOOL HandleModConWaveSetWaveform(const TPacket* const packetPtr)
  * \brief Sets waveform to active AWG channel 
+ * \param packetPtr a pointer to received packet
  */
-BOOL HandleModConWaveSetWaveform(void)
+BOOL HandleModConWaveSetWaveform(const TPacket* const packetPtr)
 {
   static UINT8 waveformTypeLookupTable[6] =
   {
@@ -728,7 +1153,7 @@ BOOL HandleModConWaveSetWaveform(void)
   {
     if (AWG_Channel[index].isActive)
     {
-      AWG_Channel[index].waveformType = waveformTypeLookupTable[Packet_Parameter2];
+      AWG_Channel[index].waveformType = waveformTypeLookupTable[Packet_Parameter2Of(packetPtr)];
       AWG_Update(AWGChannelLookupTable[index]);
     }
   }
@@ -737,10 +1162,11 @@ BOOL HandleModConWaveSetWaveform(void)
 }
 
 /**
- * \fn BOOL HandleModConWaveSetFrequency(void)
+ * \fn BOOL HandleModConWaveSetFrequency(const TPacket* const packetPtr)
  * \brief Sets frequency value to active AWG channel 
+ * \param packetPtr a pointer to received packet
  */
-BOOL HandleModConWaveSetFrequency(void)
+BOOL HandleModConWaveSetFrequency(const TPacket* const packetPtr)
 {
   UINT8 index = 0;  
   
@@ -748,7 +1174,7 @@ BOOL HandleModConWaveSetFrequency(void)
   {
     if (AWG_Channel[index].isActive)
     {
-      AWG_Channel[index].frequency = Packet_Parameter23;
+      AWG_Channel[index].frequency = Packet_Parameter23Of(packetPtr);
       AWG_Update(AWGChannelLookupTable[index]);
     }
   }
@@ -757,10 +1183,11 @@ BOOL HandleModConWaveSetFrequency(void)
 }
 
 /**
- * \fn BOOL HandleModConWaveSetOffset(void)
+ * \fn BOOL HandleModConWaveSetOffset(const TPacket* const packetPtr)
  * \brief Sets offset value to active AWG channel 
+ * \param packetPtr a pointer to received packet
  */
-BOOL HandleModConWaveSetAmplitude(void)
+BOOL HandleModConWaveSetAmplitude(const TPacket* const packetPtr)
 {
   UINT8 index = 0;
 
@@ -768,7 +1195,7 @@ BOOL HandleModConWaveSetAmplitude(void)
   {
     if (AWG_Channel[index].isActive)
     {
-      AWG_Channel[index].amplitude = Packet_Parameter23;
+      AWG_Channel[index].amplitude = Packet_Parameter23Of(packetPtr);
       AWG_Update(AWGChannelLookupTable[index]);
     }
   }
@@ -777,10 +1204,11 @@ BOOL HandleModConWaveSetAmplitude(void)
 }
 
 /**
- * \fn BOOL HandleModConWaveSetOffset(void)
+ * \fn BOOL HandleModConWaveSetOffset(const TPacket* const packetPtr)
  * \brief Sets offset value to active AWG channel 
+ * \param packetPtr a pointer to received packet
  */
-BOOL HandleModConWaveSetOffset(void)
+BOOL HandleModConWaveSetOffset(const TPacket* const packetPtr)
 {
   UINT8 index = 0;
 
@@ -788,7 +1216,7 @@ BOOL HandleModConWaveSetOffset(void)
   {
     if (AWG_Channel[index].isActive)
     {
-      AWG_Channel[index].offset = Packet_Parameter23;
+      AWG_Channel[index].offset = Packet_Parameter23Of(packetPtr);
       AWG_Update(AWGChannelLookupTable[index]);
     }
   }
@@ -803,91 +1231,486 @@ BOOL HandleModConWaveSetOffset(void)
 BOOL HandleModConWaveEnable(BOOL enable)
 {
   UINT8 index = 0;
+  BOOL success = bTRUE;
 
   for (index = 0; index < NB_AWG_CHANNELS; ++index)
   {
     if (AWG_Channel[index].isActive)
     {
       AWG_Channel[index].isEnabled = enable;
-      AWG_Enable(AWGChannelLookupTable[index], enable);
+      
+      if (!AWG_Enable(AWGChannelLookupTable[index], enable))
+      { /* rejected by CPU budget */
+        AWG_Channel[index].isEnabled = bFALSE;
+        success = bFALSE;
+      }
     }
   }
 
-  return bTRUE;
+  return success;
 }
 
 /**
- * \fn BOOL HandleModConWaveActiveChannel(void)
- * \brief Activates selected AWG channel to response to incoming settings
+ * \fn BOOL HandleModConWaveGetUnderrun(void)
+ * \brief Sends sample buffer underrun count of active AWG channel
  */
-BOOL HandleModConWaveActiveChannel(void)
+BOOL HandleModConWaveGetUnderrun(void)
 {
-  if (Packet_Parameter2 == 0)
+  UINT8 index = 0;
+  TUINT16 count;
+  BOOL success = bFALSE;
+
+  for (index = 0; index < NB_AWG_CHANNELS; ++index)
   {
-    AWG_Channel[0].isActive = bTRUE;
-    AWG_Channel[1].isActive = bFALSE;
-    //AWG_Channel[2].isActive = bFALSE;
-    //AWG_Channel[3].isActive = bFALSE;    
-  
-    return bTRUE;
+    if (AWG_Channel[index].isActive)
+    {
+      count.l = AWG_GetUnderrunCount(AWGChannelLookupTable[index]);
+      success = Packet_Put(MODCON_COMMAND_WAVE, MODCON_WAVE_UNDERRUN, count.s.Lo, count.s.Hi);
+    }
   }
-  else if (Packet_Parameter2 == 1)
-  {
-    AWG_Channel[0].isActive = bFALSE;
-    AWG_Channel[1].isActive = bTRUE;
-    //AWG_Channel[2].isActive = bFALSE;
-    //AWG_Channel[3].isActive = bFALSE;    
 
-    return bTRUE;
-  }
-  
-  return bFALSE;
+  return success;
 }
 
 /**
- * \fn BOOL HandleModConArbitraryWave(void)
- * \brief Handles arbitrary wave packet
+ * \fn BOOL HandleModConWaveSetArbitrarySlot(const TPacket* const packetPtr)
+ * \brief Sets waveform slot played by active AWG channel
+ * \param packetPtr a pointer to received packet
  */
-BOOL HandleModConArbitraryWave(void)
+BOOL HandleModConWaveSetArbitrarySlot(const TPacket* const packetPtr)
 {
   UINT8 index = 0;
 
-  if (Packet_Parameter1 < AWG_ARBITRARY_WAVE_SIZE)
+  for (index = 0; index < NB_AWG_CHANNELS; ++index)
   {
-
-    for (index = 0; index < NB_AWG_CHANNELS; ++index)
+    if (AWG_Channel[index].isActive)
     {
-      if (AWG_Channel[index].isActive)
-      {
-        CRG_ResetCOP(); /* it gives more time for caculations */
-        AWG_Channel[index].arbitraryWave[Packet_Parameter1] = (2047 - (INT32)Packet_Parameter23) * 10; /* match our other AWG waveform sample scale */
-      }
+      AWG_Channel[index].arbitrarySlot = Packet_Parameter2Of(packetPtr);
+      AWG_Update(AWGChannelLookupTable[index]);
     }
-    //AWG_ARBITRARY_WAVE[Packet_Parameter1] = (2047 - (INT32)Packet_Parameter23) * 10; /* match our other AWG waveform sample scale */
-    return bTRUE;
   }
-  return bFALSE;
-}
+
+  return bTRUE;
+}
+
+/**
+ * \fn BOOL HandleModConWaveSetSamplePeriod(const TPacket* const packetPtr)
+ * \brief Sets sample period in microseconds to active AWG channel
+ * \param packetPtr a pointer to received packet
+ */
+BOOL HandleModConWaveSetSamplePeriod(const TPacket* const packetPtr)
+{
+  UINT8 index = 0;
+  BOOL success = bTRUE;
+
+  for (index = 0; index < NB_AWG_CHANNELS; ++index)
+  {
+    if (AWG_Channel[index].isActive)
+    {
+      success = AWG_SetSamplePeriod(AWGChannelLookupTable[index], Packet_Parameter23Of(packetPtr)) && success;
+    }
+  }
+
+  return success;
+}
+
+/**
+ * \fn BOOL HandleModConWaveSetNoiseType(const TPacket* const packetPtr)
+ * \brief Sets noise distribution to active AWG channel, 0 for uniform and 1 for gaussian
+ * \param packetPtr a pointer to received packet
+ */
+BOOL HandleModConWaveSetNoiseType(const TPacket* const packetPtr)
+{
+  static UINT8 noiseTypeLookupTable[2] =
+  {
+    AWG_NOISE_UNIFORM,
+    AWG_NOISE_GAUSSIAN
+  };
+
+  UINT8 index = 0;
+
+  for (index = 0; index < NB_AWG_CHANNELS; ++index)
+  {
+    if (AWG_Channel[index].isActive)
+    {
+      AWG_Channel[index].noiseType = noiseTypeLookupTable[Packet_Parameter2Of(packetPtr)];
+      AWG_Update(AWGChannelLookupTable[index]);
+    }
+  }
+
+  return bTRUE;
+}
+
+/**
+ * \fn BOOL HandleModConWaveSetUpdateMode(const TPacket* const packetPtr)
+ * \brief Sets when new settings take over on active AWG channel, 0 for next sample and 1 for next period
+ * \param packetPtr a pointer to received packet
+ */
+BOOL HandleModConWaveSetUpdateMode(const TPacket* const packetPtr)
+{
+  UINT8 index = 0;
+
+  for (index = 0; index < NB_AWG_CHANNELS; ++index)
+  {
+    if (AWG_Channel[index].isActive)
+    {
+      AWG_Channel[index].isUpdateDeferred = (BOOL)(Packet_Parameter2Of(packetPtr) == 1);
+    }
+  }
+
+  return bTRUE;
+}
+
+/**
+ * \fn BOOL HandleModConWaveSetTelemetry(const TPacket* const packetPtr)
+ * \brief Sets telemetry of active AWG channel, decimation in parameter 2 with 0 for off and aggregation in parameter 3
+ * \param packetPtr a pointer to received packet
+ * \return FALSE if aggregation is unknown or no channel is active
+ */
+BOOL HandleModConWaveSetTelemetry(const TPacket* const packetPtr)
+{
+  UINT8 index = 0;
+  BOOL isUpdated = bFALSE;
+
+  if (Packet_Parameter3Of(packetPtr) > MODCON_TELEMETRY_RANGE)
+  {
+    return bFALSE;
+  }
+
+  for (index = 0; index < NB_AWG_CHANNELS; ++index)
+  {
+    if (AWG_Channel[index].isActive)
+    {
+      /* AWG routine leaves a channel without decimation alone */
+      ModConTelemetry[index].decimation = 0;
+      ModConTelemetry[index].mode = Packet_Parameter3Of(packetPtr);
+      ModConTelemetry[index].count = 0;
+      ModConTelemetry[index].isReady = bFALSE;
+      ModConTelemetry[index].decimation = Packet_Parameter2Of(packetPtr);
+      isUpdated = bTRUE;
+    }
+  }
+
+  return isUpdated;
+}
+
+/**
+ * \fn BOOL HandleModConWaveActiveChannel(const TPacket* const packetPtr)
+ * \brief Activates selected AWG channel to response to incoming settings
+ * \param packetPtr a pointer to received packet
+ */
+BOOL HandleModConWaveActiveChannel(const TPacket* const packetPtr)
+{
+  UINT8 index = 0;
+
+  if (Packet_Parameter2Of(packetPtr) < NB_AWG_CHANNELS)
+  {
+    for (index = 0; index < NB_AWG_CHANNELS; ++index)
+    {
+      AWG_Channel[index].isActive = (index == Packet_Parameter2Of(packetPtr));
+    }
+  
+    return bTRUE;
+  }
+  
+  return bFALSE;
+}
+
+/**
+ * \fn BOOL HandleModConArbitraryWave(const TPacket* const packetPtr)
+ * \brief Handles arbitrary wave packet
+ * \param packetPtr a pointer to received packet
+ */
+BOOL HandleModConArbitraryWave(const TPacket* const packetPtr)
+{
+  UINT8 index = 0;
+
+  if (Packet_Parameter1Of(packetPtr) < AWG_ARBITRARY_WAVE_SIZE)
+  {
+
+    for (index = 0; index < NB_AWG_CHANNELS; ++index)
+    {
+      if (AWG_Channel[index].isActive)
+      {
+        CRG_ResetCOP(); /* it gives more time for caculations */
+        AWG_WaveSlot[AWG_Channel[index].arbitrarySlot][Packet_Parameter1Of(packetPtr)] = (INT16)((2047 - (INT32)Packet_Parameter23Of(packetPtr)) << 4); /* DAC value to Q15 waveform sample */
+      }
+    }
+    //AWG_ARBITRARY_WAVE[Packet_Parameter1Of(packetPtr)] = (2047 - (INT32)Packet_Parameter23Of(packetPtr)) * 10; /* match our other AWG waveform sample scale */
+    return bTRUE;
+  }
+  return bFALSE;
+}
+
+/**
+ * \fn BOOL HandleModConArbitraryBlock(const TPacket* const packetPtr)
+ * \brief Handles block of packed arbitrary wave samples
+ * \param packetPtr a pointer to received packet
+ * \return TRUE if block was intact and stored
+ * \note parameter1 is first sample index, parameter2 is sample count (0 for 256) and parameter3 is XOR of payload bytes.
+ *       Every two samples are packed into three bytes, most significant nibble first.
+ */
+BOOL HandleModConArbitraryBlock(const TPacket* const packetPtr)
+{
+  UINT16 count = 0, sampleIndex = 0, byteIndex = 0;
+  UINT8 index = 0, checksum = 0;
+  TUINT16 sample;
+
+  count = Packet_Parameter2Of(packetPtr) ? Packet_Parameter2Of(packetPtr) : 256;
+
+  if (Packet_PayloadLength != ModConPayloadLength(Packet_CommandOf(packetPtr), Packet_Parameter1Of(packetPtr), Packet_Parameter2Of(packetPtr), Packet_Parameter3Of(packetPtr)) ||
+      Packet_Parameter1Of(packetPtr) + count > AWG_ARBITRARY_WAVE_SIZE)
+  {
+    return bFALSE;
+  }
+
+  for (byteIndex = 0; byteIndex < Packet_PayloadLength; ++byteIndex)
+  {
+    checksum ^= Packet_Payload[byteIndex];
+  }
+
+  if (checksum != Packet_Parameter3Of(packetPtr))
+  {
+    return bFALSE;
+  }
+
+  for (sampleIndex = 0, byteIndex = 0; sampleIndex < count; ++sampleIndex)
+  {
+    if (sampleIndex & 1)
+    {
+      sample.s.Hi = Packet_Payload[byteIndex] & 0x0F;
+      sample.s.Lo = Packet_Payload[byteIndex + 1];
+      byteIndex += 2;
+    }
+    else
+    {
+      sample.l = ((UINT16)Packet_Payload[byteIndex] << 4) | (Packet_Payload[byteIndex + 1] >> 4);
+      byteIndex += 1;
+    }
+
+    for (index = 0; index < NB_AWG_CHANNELS; ++index)
+    {
+      if (AWG_Channel[index].isActive)
+      {
+        AWG_WaveSlot[AWG_Channel[index].arbitrarySlot][Packet_Parameter1Of(packetPtr) + sampleIndex] = (INT16)((2047 - (INT32)sample.l) << 4); /* DAC value to Q15 waveform sample */
+      }
+    }
+  }
+
+  return bTRUE;
+}
+
+/**
+ * \fn BOOL HandleModConSweep(const TPacket* const packetPtr)
+ * \brief Handles frequency sweep packet
+ * \param packetPtr a pointer to received packet
+ * \return TRUE if sweep was started or stopped
+ * \note parameter1 is profile (0 off, 1 linear, 2 logarithmic), parameter2 is 0 and parameter3 is XOR of payload bytes.
+ *       Payload carries start frequency, stop frequency and duration in milliseconds, low byte first.
+ */
+BOOL HandleModConSweep(const TPacket* const packetPtr)
+{
+  static UINT8 sweepProfileLookupTable[3] =
+  {
+    AWG_SWEEP_OFF,
+    AWG_SWEEP_LINEAR,
+    AWG_SWEEP_LOGARITHMIC
+  };
+
+  TUINT16 startFrequency, stopFrequency, duration;
+  UINT8 index = 0, checksum = 0;
+  BOOL success = bTRUE;
+
+  if (Packet_PayloadLength != MODCON_SWEEP_PAYLOAD_LENGTH || Packet_Parameter1Of(packetPtr) > 2 || Packet_Parameter2Of(packetPtr) != 0)
+  {
+    return bFALSE;
+  }
+
+  for (index = 0; index < MODCON_SWEEP_PAYLOAD_LENGTH; ++index)
+  {
+    checksum ^= Packet_Payload[index];
+  }
+
+  if (checksum != Packet_Parameter3Of(packetPtr))
+  {
+    return bFALSE;
+  }
+
+  startFrequency.s.Lo = Packet_Payload[0];
+  startFrequency.s.Hi = Packet_Payload[1];
+  stopFrequency.s.Lo = Packet_Payload[2];
+  stopFrequency.s.Hi = Packet_Payload[3];
+  duration.s.Lo = Packet_Payload[4];
+  duration.s.Hi = Packet_Payload[5];
+
+  for (index = 0; index < NB_AWG_CHANNELS; ++index)
+  {
+    if (AWG_Channel[index].isActive)
+    {
+      success = AWG_Sweep(AWGChannelLookupTable[index], sweepProfileLookupTable[Packet_Parameter1Of(packetPtr)], startFrequency.l, stopFrequency.l, duration.l) && success;
+    }
+  }
+
+  return success;
+}
+
+/**
+ * \fn BOOL HandleModConAnalogCaptureGetStatus(void)
+ * \brief Builds a packet that contains analog capture state and places it into transmit buffer.
+ * \return TRUE if the packet was queued for transmission successfully.
+ */
+BOOL HandleModConAnalogCaptureGetStatus(void)
+{
+  if (!Packet_Put(MODCON_COMMAND_ANALOG_CAPTURE, MODCON_CAPTURE_STATUS, (UINT8)Analog_CaptureState(), 0))
+  {
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_PACKET_PUT);
+#endif
+    return bFALSE;
+  }
+  return bTRUE;
+}
+
+/**
+ * \fn BOOL HandleModConAnalogCaptureArm(void)
+ * \brief Arms analog capture with staged settings, a previous capture left unsent is dropped
+ * \return TRUE if capture has been armed
+ */
+BOOL HandleModConAnalogCaptureArm(void)
+{
+  if (!Analog_CaptureArm(ModConCapture.channelMask, ModConCapture.samplePeriod, ModConCapture.nbSamples,
+                         ModConCapture.trigger, ModConCapture.level, CONFIG_BUSCLK))
+  {
+    return bFALSE;
+  }
+  
+  ModConCapture.nbSent = 0;
+  ModConCapture.isReported = bFALSE;
+  
+  return HandleModConAnalogCaptureGetStatus();
+}
+
+/**
+ * \fn BOOL HandleModConAnalogCapture(const TPacket* const packetPtr)
+ * \brief response to ModCon analog capture commands. 
+ * \param packetPtr a pointer to received packet
+ * \return TRUE if the command has been executed successfully.
+ * \note Settings are staged until next arm, they are checked against each other by then.
+ */
+BOOL HandleModConAnalogCapture(const TPacket* const packetPtr)
+{
+  switch(Packet_Parameter1Of(packetPtr))
+  {
+    case MODCON_CAPTURE_STATUS:
+      if (Packet_Parameter23Of(packetPtr) == 0)
+      {
+        return HandleModConAnalogCaptureGetStatus();
+      }
+      break;
+    case MODCON_CAPTURE_CHANNELS:
+      if (Packet_Parameter2Of(packetPtr) && Packet_Parameter3Of(packetPtr) == 0)
+      {
+        ModConCapture.channelMask = Packet_Parameter2Of(packetPtr);
+        return bTRUE;
+      }
+      break;
+    case MODCON_CAPTURE_PERIOD:
+      if (Packet_Parameter23Of(packetPtr) >= ANALOG_CAPTURE_CHANNEL_PERIOD && Packet_Parameter23Of(packetPtr) <= ANALOG_CAPTURE_PERIOD_MAXIMUM)
+      {
+        ModConCapture.samplePeriod = Packet_Parameter23Of(packetPtr);
+        return bTRUE;
+      }
+      break;
+    case MODCON_CAPTURE_COUNT:
+      if (Packet_Parameter23Of(packetPtr) && Packet_Parameter23Of(packetPtr) <= ANALOG_CAPTURE_SIZE)
+      {
+        ModConCapture.nbSamples = Packet_Parameter23Of(packetPtr);
+        return bTRUE;
+      }
+      break;
+    case MODCON_CAPTURE_TRIGGER:
+      if (Packet_Parameter2Of(packetPtr) <= ANALOG_TRIGGER_FALLING && Packet_Parameter3Of(packetPtr) == 0)
+      {
+        ModConCapture.trigger = (TAnalogTrigger)Packet_Parameter2Of(packetPtr);
+        return bTRUE;
+      }
+      break;
+    case MODCON_CAPTURE_LEVEL:
+      ModConCapture.level = (INT16)Packet_Parameter23Of(packetPtr);
+      return bTRUE;
+    case MODCON_CAPTURE_ARM:
+      if (Packet_Parameter23Of(packetPtr) == 0)
+      {
+        return HandleModConAnalogCaptureArm();
+      }
+      break;
+    case MODCON_CAPTURE_ABORT:
+      if (Packet_Parameter23Of(packetPtr) == 0)
+      {
+        Analog_CaptureAbort();
+        ModConCapture.isReported = bTRUE;
+        return HandleModConAnalogCaptureGetStatus();
+      }
+      break;
+    default:
+      break;
+  }
+  return bFALSE;
+}
 
 /**
- * \fn BOOL HandleModConArbitraryPhasor(void)
+ * \fn UINT16 ModConPayloadLength(const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3)
+ * \brief Tells packet module how many payload bytes follow given packet
+ * \return payload length in bytes
+ */
+UINT16 ModConPayloadLength(const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3)
+{
+  UINT16 count = 0;
+
+  UNUSED(parameter1);
+  UNUSED(parameter3);
+
+  if ((command & ~MODCON_COMMAND_ACK_MASK) == MODCON_COMMAND_ARBITRARY_BLOCK)
+  {
+    count = parameter2 ? parameter2 : 256;
+    return (count * 3 + 1) / 2; /* 12 bits per sample */
+  }
+  
+  if ((command & ~MODCON_COMMAND_ACK_MASK) == MODCON_COMMAND_SWEEP)
+  {
+    return MODCON_SWEEP_PAYLOAD_LENGTH;
+  }
+
+  return 0;
+}
+
+/**
+ * \fn BOOL HandleModConArbitraryPhasor(const TPacket* const packetPtr)
  * \brief Handles arbitrary phasor packet
+ * \param packetPtr a pointer to received packet
  */
-BOOL HandleModConArbitraryPhasor(void)
+BOOL HandleModConArbitraryPhasor(const TPacket* const packetPtr)
 {
   UINT16 index = 0;
   UINT8 harmonicNb = 0xFF;
   UINT16 magnitude = 0xFFFF;
   INT16 angle = 0xFFFF;
+  UINT8 channelIndex = 0;
   
-  harmonicNb = Packet_Parameter1 >> 4;
-  angle = ((Packet_Parameter1 & 0x0F) << 6) | ((Packet_Parameter2 & 0xFC) >> 2);
-  magnitude = ((Packet_Parameter2 & 0x03) << 8) | Packet_Parameter3;
+  harmonicNb = Packet_Parameter1Of(packetPtr) >> 4;
+  angle = ((Packet_Parameter1Of(packetPtr) & 0x0F) << 6) | ((Packet_Parameter2Of(packetPtr) & 0xFC) >> 2);
+  magnitude = ((Packet_Parameter2Of(packetPtr) & 0x03) << 8) | Packet_Parameter3Of(packetPtr);
   
   switch(harmonicNb)
   {
     case MODCON_ARBITRARY_PHASOR_RESET:
-      AWG_ResetArbitraryWave();
+      for (channelIndex = 0; channelIndex < NB_AWG_CHANNELS; ++channelIndex)
+      {
+        if (AWG_Channel[channelIndex].isActive)
+        {
+          AWG_ResetArbitraryWave(AWG_Channel[channelIndex].arbitrarySlot);
+        }
+      }
       break;
     case MODCON_ARBITRARY_PHASOR_HARMONIC_1:
     case MODCON_ARBITRARY_PHASOR_HARMONIC_2:
@@ -904,7 +1727,13 @@ BOOL HandleModConArbitraryPhasor(void)
     case MODCON_ARBITRARY_PHASOR_HARMONIC_D:
     case MODCON_ARBITRARY_PHASOR_HARMONIC_E:
     case MODCON_ARBITRARY_PHASOR_HARMONIC_F:
-      AWG_ApplyArbitraryPhasor(harmonicNb, magnitude, angle);
+      for (channelIndex = 0; channelIndex < NB_AWG_CHANNELS; ++channelIndex)
+      {
+        if (AWG_Channel[channelIndex].isActive)
+        {
+          AWG_ApplyArbitraryPhasor(AWG_Channel[channelIndex].arbitrarySlot, harmonicNb, magnitude, angle);
+        }
+      }
       break;
     default:
       return bFALSE;
@@ -966,7 +1795,12 @@ void SampleAnalogChannels(void)
   {
     if (ModConAnalogInputChannelSwitch & inputChannelSwitchMaskLookupTable[index])
     {      
-      mutated = Analog_Get(inputChannelNumberLookupTable[index]);
+      /* a conversion SPI queue had no room for leaves a stale value, it is not reported as a fresh one */
+      if (!Analog_Get(inputChannelNumberLookupTable[index], &mutated) && !mutated)
+      {
+        continue;
+      }
+      
       if (ModConProtocolMode == MODCON_PROTOCOL_MODE_SYNCHRONOUS)
       { 
         /* NOTE: debug is inside HandleModConAnalogInputValue */ 	
@@ -992,39 +1826,213 @@ void SampleAnalogChannels(void)
 
 /**
  * \fn void AWGPostProcessRoutine(TAWGChannel channelNb)
- * \brief Sends out AWG channel value after analog process that is finished
+ * \brief Gathers AWG channel value into its telemetry window
  * \param channelNb AWG channel number
  */
 void AWGPostProcessRoutine(TAWGChannel channelNb)
 {
   UINT8 index = 0xFF;                      
-  TAnalogChannel analogChannelNb;
+  TModConTelemetry* telemetryPtr = (TModConTelemetry*) 0x0000;
+  INT16 value = 0;
+  
   switch(channelNb)
   {
     case AWG_Ch1:
-      analogChannelNb = ANALOG_OUTPUT_Ch1;
       index = 0;
       break;
     case AWG_Ch2:
-      analogChannelNb = ANALOG_OUTPUT_Ch2;
       index = 1;
       break;
     case AWG_Ch3:
-      analogChannelNb = ANALOG_OUTPUT_Ch3;
       index = 2;
       break;
     case AWG_Ch4:
-      analogChannelNb = ANALOG_OUTPUT_Ch4;
       index = 3;
       break;
     default:
       return;
       break;
   }
-  //if (Analog_Output[index].Value.l != Analog_Output[index].OldValue.l)
-  //{    
-    UNUSED(HandleModConAnalogOutputValue(analogChannelNb));
-  //}
+  
+  telemetryPtr = &ModConTelemetry[index];
+  
+  if (!telemetryPtr->decimation)
+  {
+    return;
+  }
+  
+  value = Analog_Output[index].Value.l;
+  
+  if (telemetryPtr->count == 0)
+  {
+    telemetryPtr->minimum = value;
+    telemetryPtr->maximum = value;
+    telemetryPtr->sum = 0;
+  }
+  else if (value < telemetryPtr->minimum)
+  {
+    telemetryPtr->minimum = value;
+  }
+  else if (value > telemetryPtr->maximum)
+  {
+    telemetryPtr->maximum = value;
+  }
+  
+  telemetryPtr->sum += value;
+  
+  if (++telemetryPtr->count < telemetryPtr->decimation)
+  {
+    return;
+  }
+  
+  telemetryPtr->count = 0;
+  
+  /* window is dropped while previous report still waits for transmit room */
+  if (!telemetryPtr->isReady)
+  {
+    if (telemetryPtr->mode == MODCON_TELEMETRY_MEAN)
+    {
+      telemetryPtr->report[0] = (INT16)(telemetryPtr->sum / telemetryPtr->decimation);
+    }
+    else if (telemetryPtr->mode == MODCON_TELEMETRY_RANGE)
+    {
+      telemetryPtr->report[0] = telemetryPtr->minimum;
+      telemetryPtr->report[1] = telemetryPtr->maximum;
+    }
+    else
+    {
+      telemetryPtr->report[0] = value;
+    }
+    
+    telemetryPtr->isReady = bTRUE;
+    WakeRoutine();
+  }
+}
+
+/**
+ * \fn void WakeRoutine(void)
+ * \brief Wakes up routine thread, safe to call from interrupts
+ */
+void WakeRoutine(void)
+{
+  if (RoutineSemaphorePtr)
+  {
+    UNUSED(OS_SemaphoreSignal(RoutineSemaphorePtr));
+  }
+}
+
+/**
+ * \fn void SendModConTelemetry(void)
+ * \brief Sends finished telemetry reports as long as transmit room is left for command responses
+ */
+void SendModConTelemetry(void)
+{
+  UINT8 index = 0;
+  UINT16 nbPackets = 0;
+  TINT16 value;
+  
+  for (index = 0; index < NB_AWG_CHANNELS; ++index)
+  {
+    if (ModConTelemetry[index].isReady)
+    {
+      nbPackets = (ModConTelemetry[index].mode == MODCON_TELEMETRY_RANGE) ? 2 : 1;
+      
+      if (Packet_WouldBlock(SCI_TX_BULK, nbPackets))
+      {
+        return;
+      }
+      
+      /* same value convention as analog output value */
+      value.l = 0x07FF - ModConTelemetry[index].report[0];
+      
+      if (ModConTelemetry[index].mode == MODCON_TELEMETRY_RANGE)
+      {
+        UNUSED(Packet_PutBulk(MODCON_COMMAND_ANALOG_OUTPUT_MINIMUM, index, value.s.Lo, value.s.Hi));
+        value.l = 0x07FF - ModConTelemetry[index].report[1];
+        UNUSED(Packet_PutBulk(MODCON_COMMAND_ANALOG_OUTPUT_MAXIMUM, index, value.s.Lo, value.s.Hi));
+      }
+      else
+      {
+        UNUSED(Packet_PutBulk(MODCON_COMMAND_ANALOG_OUTPUT_VALUE, index, value.s.Lo, value.s.Hi));
+      }
+      
+      ModConTelemetry[index].isReady = bFALSE;
+    }
+  }
+}
+
+/**
+ * \fn void SendModConCapture(void)
+ * \brief Streams a stopped capture out in blocks as long as bulk transmit room is left, then reports how it ended
+ * \note Samples are packed like arbitrary wave blocks, 12-bit two's complement saturated at 2047.
+ */
+void SendModConCapture(void)
+{
+  static UINT8 payload[(MODCON_CAPTURE_BLOCK_SAMPLES * 3 + 1) / 2];
+  TAnalogCaptureState state = Analog_CaptureState();
+  UINT16 length = 0, nbSamples = 0, sampleIndex = 0, byteIndex = 0, payloadLength = 0;
+  TUINT16 sample, offset;
+  INT16 value = 0;
+  
+  if (ModConCapture.isReported || (state != ANALOG_CAPTURE_DONE && state != ANALOG_CAPTURE_OVERRUN))
+  {
+    return;
+  }
+  
+  /* overrun capture has lost its interleaving, only its end is reported */
+  length = (state == ANALOG_CAPTURE_DONE) ? Analog_CaptureLength() : 0;
+  
+  while (ModConCapture.nbSent < length)
+  {
+    nbSamples = length - ModConCapture.nbSent;
+    
+    if (nbSamples > MODCON_CAPTURE_BLOCK_SAMPLES)
+    {
+      nbSamples = MODCON_CAPTURE_BLOCK_SAMPLES;
+    }
+    payloadLength = (nbSamples * 3 + 1) / 2;
+    
+    if (Packet_PayloadWouldBlock(SCI_TX_BULK, payloadLength))
+    {
+      return;
+    }
+    
+    for (sampleIndex = 0, byteIndex = 0; sampleIndex < nbSamples; ++sampleIndex)
+    {
+      /* ADC code 0 reads +2048, it would wrap to the opposite rail in 12 bits */
+      value = Analog_CaptureBuffer[ModConCapture.nbSent + sampleIndex];
+      if (value > 2047)
+      {
+        value = 2047;
+      }
+      sample.l = (UINT16)value & 0x0FFF;
+      
+      if (sampleIndex & 1)
+      {
+        payload[byteIndex] |= sample.s.Hi;
+        payload[byteIndex + 1] = sample.s.Lo;
+        byteIndex += 2;
+      }
+      else
+      {
+        payload[byteIndex] = (UINT8)(sample.l >> 4);
+        payload[byteIndex + 1] = (UINT8)(sample.s.Lo << 4);
+        byteIndex += 1;
+      }
+    }
+    
+    offset.l = ModConCapture.nbSent;
+    UNUSED(Packet_PutPayload(SCI_TX_BULK, MODCON_COMMAND_ANALOG_CAPTURE, MODCON_CAPTURE_BLOCK, offset.s.Lo, offset.s.Hi, payload, payloadLength));
+    ModConCapture.nbSent += nbSamples;
+  }
+  
+  if (Packet_WouldBlock(SCI_TX_BULK, 1))
+  {
+    return;
+  }
+  
+  UNUSED(Packet_PutBulk(MODCON_COMMAND_ANALOG_CAPTURE, MODCON_CAPTURE_STATUS, (UINT8)state, 0));
+  ModConCapture.isReported = bTRUE;
 }
 
 /**
@@ -1061,6 +2069,36 @@ BOOL Initialize(void) /* TODO: check following statements */
     return bFALSE;
   }
   
+  Packet_AttachPayloadLengthRoutine(&ModConPayloadLength);
+  Packet_AttachReceivedRoutine(&WakeRoutine);
+  
+  /* every ModCon command reaches its handler through packet dispatch table */
+  UNUSED(Packet_RegisterHandler(MODCON_COMMAND_STARTUP, &HandleModConStartup));
+  UNUSED(Packet_RegisterHandler(MODCON_COMMNAD_EEPROM_PROGRAM, &HandleModConEEPROMProgram));
+  UNUSED(Packet_RegisterHandler(MODCON_COMMAND_EEPROM_GET, &HandleModConEEPROMGet));
+  UNUSED(Packet_RegisterHandler(MODCON_COMMAND_SPECIAL, &HandleModConSpecial));
+  UNUSED(Packet_RegisterHandler(MODCON_COMMAND_PROTOCOL_MODE, &HandleModConProtocolMode));
+  UNUSED(Packet_RegisterHandler(MODCON_COMMAND_NUMBER, &HandleModConNumber));
+  UNUSED(Packet_RegisterHandler(MODCON_COMMAND_MODE, &HandleModConMode));
+  UNUSED(Packet_RegisterHandler(MODCON_COMMAND_BAUD_RATE, &HandleModConBaudRate));
+  UNUSED(Packet_RegisterHandler(MODCON_COMMAND_FRAMING, &HandleModConFraming));
+  UNUSED(Packet_RegisterHandler(MODCON_COMMAND_TX_DROPS, &HandleModConTxDrops));
+  UNUSED(Packet_RegisterHandler(MODCON_COMMAND_WAVE, &HandleModConWave));
+  UNUSED(Packet_RegisterHandler(MODCON_COMMAND_ARBITRARY_WAVE, &HandleModConArbitraryWave));
+  UNUSED(Packet_RegisterHandler(MODCON_COMMAND_ARBITRARY_PHASOR, &HandleModConArbitraryPhasor));
+  UNUSED(Packet_RegisterHandler(MODCON_COMMAND_ARBITRARY_BLOCK, &HandleModConArbitraryBlock));
+  UNUSED(Packet_RegisterHandler(MODCON_COMMAND_SWEEP, &HandleModConSweep));
+  UNUSED(Packet_RegisterHandler(MODCON_COMMAND_ANALOG_CAPTURE, &HandleModConAnalogCapture));
+  
+  /* baud rate kept from an earlier negotiation goes on trial, default one comes back unless a packet is heard at it in time */
+  ModConLink.baudRate = CONFIG_SCI_BAUDRATE;
+  if (ModConBaudRate != 0xFFFF && (UINT32)ModConBaudRate * MODCON_BAUD_RATE_UNIT != CONFIG_SCI_BAUDRATE &&
+      SCI_BaudRateDivisor((UINT32)ModConBaudRate * MODCON_BAUD_RATE_UNIT, CONFIG_BUSCLK))
+  {
+    ModConLink.trialBaudRate = (UINT32)ModConBaudRate * MODCON_BAUD_RATE_UNIT;
+    ModConLink.isStoredTrial = bTRUE;
+  }
+  
   if (!CRG_SetupCOP(CONFIG_COP_RATE))
   {
 #ifndef NO_DEBUG
@@ -1175,7 +2213,7 @@ BOOL Initialize(void) /* TODO: check following statements */
   Analog_Setup(CONFIG_BUSCLK);
   
   AWG_Setup(CONFIG_BUSCLK);
-  //AWG_AttachPostProcessRoutine(&AWGPostProcessRoutine);
+  AWG_AttachPostProcessRoutine(&AWGPostProcessRoutine); /* quiet until telemetry decimation is set */
   
   //Timer_SetupPeriodicTimer(ModConAnalogInputSamplingRate, CONFIG_BUSCLK);
   //Timer_AttachPeriodicTimerRoutine(&SampleAnalogChannels);
@@ -1218,68 +2256,58 @@ void RuntimeIndictorRoutine(void* dataPtr)
  */
 void Routine(void* dataPtr)
 {
+  TPacket packet;
   UINT8 ack = 0;
   BOOL bad = bTRUE;
   
   UNUSED(dataPtr);
+  
+  /* semaphore can only be created after OS has been initialized */
+  RoutineSemaphorePtr = OS_SemaphoreCreate(0);
     
   for (;;)
   {
-    CRG_ArmCOP();
-        
 //    if (Clock_Update())
 //    {
 //      /* hours from 0 to 23; minutes from 0 to 59; seconds from 0 to 59 */
 //      bad = !HandleModConUptime();
 //    }
 
-    if (Packet_Get())
+    /* sleep until a packet or a telemetry report comes in, transmit room and baud rate trial are checked every few ticks */
+    if (RoutineSemaphorePtr)
+    {
+      UNUSED(OS_SemaphoreWait(RoutineSemaphorePtr, MODCON_ROUTINE_WAIT_TICKS));
+    }
+    
+    /* serviced as soon as sleep is over, work below has a COP period of its own */
+    CRG_ArmCOP();
+    CRG_DisarmCOP();
+
+    /* commands stay in packet queue until their responses fit in as a whole */
+    while (!Packet_WouldBlock(SCI_TX_CONTROL, MODCON_RESPONSE_PACKETS) && Packet_Get())
     { 
-      ack = Packet_Command & MODCON_COMMAND_ACK_MASK; /* detect ACK mask from command */
-      Packet_Command &= ~MODCON_COMMAND_ACK_MASK;     /* clear ACK mask from command */
-        
-      switch(Packet_Command)
-      {     
-        case MODCON_COMMAND_STARTUP:
-          bad = !HandleModConStartup(); 
-          break;			
-			  case MODCON_COMMNAD_EEPROM_PROGRAM:
-          bad = !HandleModConEEPROMProgram();
-				  break;			
-			  case MODCON_COMMAND_EEPROM_GET:
-			    bad = !HandleModConEEPROMGet();
-				  break;      
-        case MODCON_COMMAND_SPECIAL:
-          bad = !HandleModConSpecial();
-          break;
-        case MODCON_COMMAND_PROTOCOL_MODE:
-          bad = !HandleModConProtocolMode();
-          break;
-        case MODCON_COMMAND_NUMBER:
-          bad = !HandleModConNumber();
-          break;		  
-		    case MODCON_COMMAND_MODE:
-		      bad = !HandleModConMode();
-				  break;
-        case MODCON_COMMAND_WAVE:
-          bad = !HandleModConWave();
-          break;
-        case MODCON_COMMAND_ARBITRARY_WAVE:
-          bad = !HandleModConArbitraryWave();
-          break;
-        case MODCON_COMMAND_ARBITRARY_PHASOR:
-          bad = !HandleModConArbitraryPhasor();
-          break;        
-        default:
-          bad = bTRUE;
-          break;
+      packet = Packet; /* handlers work on a copy of their own */
+      ModConLink.lastPacketTime = OS_TimeGet();
+      
+      /* host that talks at stored baud rate after a reset may not know it has to confirm it */
+      if (ModConLink.isStoredTrial && ModConLink.isOnTrial)
+      {
+        ModConLink.baudRate = ModConLink.trialBaudRate;
+        ModConLink.trialBaudRate = 0;
+        ModConLink.isOnTrial = bFALSE;
+        ModConLink.isStoredTrial = bFALSE;
       }
+      
+      ack = Packet_CommandOf(&packet) & MODCON_COMMAND_ACK_MASK; /* detect ACK mask from command */
+      Packet_CommandOf(&packet) &= ~MODCON_COMMAND_ACK_MASK;     /* clear ACK mask from command */
+        
+      bad = !Packet_Dispatch(&packet);
         
       if (ack)
       {
         if (!bad)
         {                
-          if (!Packet_Put(Packet_Command | MODCON_COMMAND_ACK_MASK, Packet_Parameter1, Packet_Parameter2, Packet_Parameter3))
+          if (!Packet_Put(Packet_CommandOf(&packet) | MODCON_COMMAND_ACK_MASK, Packet_Parameter1Of(&packet), Packet_Parameter2Of(&packet), Packet_Parameter3Of(&packet)))
           {
 #ifndef NO_DEBUG
             DEBUG(__LINE__, ERR_PACKET_PUT);
@@ -1288,7 +2316,7 @@ void Routine(void* dataPtr)
         }
         else
         { /* NOTE: ACK mask has been cleared already */
-          if (!Packet_Put(Packet_Command, Packet_Parameter1, Packet_Parameter2, Packet_Parameter3))
+          if (!Packet_Put(Packet_CommandOf(&packet), Packet_Parameter1Of(&packet), Packet_Parameter2Of(&packet), Packet_Parameter3Of(&packet)))
           {
 #ifndef NO_DEBUG
             DEBUG(__LINE__, ERR_PACKET_PUT);
@@ -1297,6 +2325,18 @@ void Routine(void* dataPtr)
         }
       }
     }
+    
+    ServiceModConLink();
+    
+    /* telemetry holds off while baud rate is changing, transmitter has to drain */
+    if (!ModConLink.trialBaudRate)
+    {
+      SendModConTelemetry();
+      SendModConCapture();
+    }
+    
+    /* serviced again before sleeping, so the wait has a COP period of its own too */
+    CRG_ArmCOP();
     CRG_DisarmCOP();
   }  
 }
@@ -1315,10 +2355,12 @@ void main(void)
   TurnOnStartupIndicator(); 
   
   /* queue startup packets for transmission */
-  UNUSED(HandleModConStartup());
+  UNUSED(SendModConStartup());
   
   UNUSED(OS_ThreadCreate(&RuntimeIndictorRoutine, 0x0000, &RuntimeIndictorRoutineStack[THREAD_STACK_SIZE - 1], 0));
-  UNUSED(OS_ThreadCreate(&Routine, 0x0000, &RoutineStack[THREAD_STACK_SIZE - 1], 1));
+  /* render thread stays above routine thread, synthesis must not wait behind command handling */
+  UNUSED(OS_ThreadCreate(&AWG_RenderRoutine, 0x0000, &AWGRenderRoutineStack[THREAD_STACK_SIZE - 1], 1));
+  UNUSED(OS_ThreadCreate(&Routine, 0x0000, &RoutineStack[THREAD_STACK_SIZE - 1], 2));
 
   OS_Start();
 }
@@ -20,8 +20,19 @@
  * <br>This will send current system uptime in minutes and seconds.
  * * 0x0D ModCon mode get and set
  * <br>This is the accessor and mutator of ModCon mode.
+ * * 0x0E ModCon baud rate get, set and confirm
+ * <br>This will move the link to a new baud rate, which falls back unless it is confirmed at the new rate in time.
+ * * 0x0F ModCon framing get and set
+ * <br>This will switch between fixed 5-byte packets and variable length frames with CRC-16 for the session.
+ * * 0x10 ModCon transmit drops
+ * <br>This will send how many packets the control (0) or bulk (1) transmit queue had no room for.
  * * 0x50 ModCon analog input value
  * <br>This will send analog input channel number and its current value.
+ * * 0x51 to 0x53 ModCon analog output telemetry
+ * <br>This will send AWG channel number and its last, mean, minimum or maximum value over a decimation window.
+ * * 0x54 ModCon analog capture
+ * <br>This will sample selected analog inputs into RAM at a fixed period once armed and triggered,
+ * then stream them out as blocks of packed 12-bit samples on the bulk transmit queue.
  *
  * \file main.h
  * \brief Program main entry file. 
@@ -34,12 +45,15 @@
 #include "global.h"
 #include "timer.h"
 #include "analog.h"
+#include "packet.h"
 //#include "AWG.h"
 //#include "HMI.h"
 //#pragma LINK_INFO DERIVATIVE "mc9s12a512" /* link mc9s12a512's library */
 
 #define THREAD_STACK_SIZE 256
 
+#define MODCON_CAPTURE_BLOCK_SAMPLES 32 /* samples in a full analog capture block, payload of 48 bytes */
+
 const UINT8 MODCON_COMMAND_STARTUP             = 0x04; /* ModCon protocol startup command */
 const UINT8 MODCON_COMMNAD_EEPROM_PROGRAM      = 0x07; /* ModCon protocol EEPROM program command */
 const UINT8 MODCON_COMMAND_EEPROM_GET          = 0x08; /* ModCon protocol EEPROM get command */
@@ -48,11 +62,19 @@ const UINT8 MODCON_COMMAND_PROTOCOL_MODE       = 0x0A; /* ModCon protocol protoc
 const UINT8 MODCON_COMMAND_NUMBER              = 0x0B; /* ModCon protocol number command */
 const UINT8 MODCON_COMMAND_TIME                = 0x0C; /* ModCon protocol time command */
 const UINT8 MODCON_COMMAND_MODE                = 0x0D; /* ModCon protocol mode command */
+const UINT8 MODCON_COMMAND_BAUD_RATE           = 0x0E; /* ModCon protocol baud rate command */
+const UINT8 MODCON_COMMAND_FRAMING             = 0x0F; /* ModCon protocol framing command */
+const UINT8 MODCON_COMMAND_TX_DROPS            = 0x10; /* ModCon protocol transmit drops command */
 const UINT8 MODCON_COMMAND_ANALOG_INPUT_VALUE  = 0x50; /* ModCon protocol analog input command */
 const UINT8 MODCON_COMMAND_ANALOG_OUTPUT_VALUE = 0x51; /* ModCon protocol analog output command */
+const UINT8 MODCON_COMMAND_ANALOG_OUTPUT_MINIMUM = 0x52; /* lowest analog output within a telemetry window */
+const UINT8 MODCON_COMMAND_ANALOG_OUTPUT_MAXIMUM = 0x53; /* highest analog output within a telemetry window */
+const UINT8 MODCON_COMMAND_ANALOG_CAPTURE      = 0x54; /* block capture of analog inputs */
 const UINT8 MODCON_COMMAND_WAVE                = 0x60;
 const UINT8 MODCON_COMMAND_ARBITRARY_WAVE      = 0x61;
 const UINT8 MODCON_COMMAND_ARBITRARY_PHASOR    = 0x62;
+const UINT8 MODCON_COMMAND_ARBITRARY_BLOCK     = 0x63; /* followed by packed 12-bit samples, parameter3 is XOR of them as header checksum does not cover payload */
+const UINT8 MODCON_COMMAND_SWEEP               = 0x64; /* followed by start, stop and duration */
 
 const UINT8 MODCON_DEBUG_INITIAL = 'd';
 const UINT8 MODCON_DEBUG_TOKEN   = 'j';
@@ -75,6 +97,32 @@ const UINT8 MODCON_TIME_INITIAL = 'i';
 const UINT8 MODCON_MODE_GET = 1;
 const UINT8 MODCON_MODE_SET = 2;
 
+const UINT8 MODCON_BAUD_RATE_GET     = 1;
+const UINT8 MODCON_BAUD_RATE_SET     = 2;
+const UINT8 MODCON_BAUD_RATE_CONFIRM = 3;
+const UINT8 MODCON_BAUD_RATE_UNIT    = 100; /* bits/sec per step of parameter 2 and 3 */
+const UINT16 MODCON_BAUD_RATE_CONFIRM_TICKS = 30; /* about two seconds for host to confirm at new baud rate */
+const UINT16 MODCON_BAUD_RATE_STORED_TICKS  = 150; /* about ten seconds for host to be heard at stored baud rate after reset */
+
+const UINT8 MODCON_FRAMING_GET = 1;
+const UINT8 MODCON_FRAMING_SET = 2;
+const UINT8 MODCON_FRAMING_V1  = 0; /* command, three parameters and XOR checksum */
+const UINT8 MODCON_FRAMING_V2  = 1; /* sync, length, command, parameters and payload, CRC-16 */
+const UINT16 MODCON_FRAMING_IDLE_TICKS = 75; /* about five seconds without a valid packet ends framing v2, host keeps it with e.g. framing get */
+
+const UINT8 MODCON_TX_DROPS_CONTROL = 0; /* command responses */
+const UINT8 MODCON_TX_DROPS_BULK    = 1; /* uptime and analog streaming */
+
+const UINT8 MODCON_CAPTURE_STATUS   = 1; /* state, see TAnalogCaptureState */
+const UINT8 MODCON_CAPTURE_CHANNELS = 2; /* bit n selects analog input channel n+1 */
+const UINT8 MODCON_CAPTURE_PERIOD   = 3; /* sample period in microseconds */
+const UINT8 MODCON_CAPTURE_COUNT    = 4; /* samples of every channel */
+const UINT8 MODCON_CAPTURE_TRIGGER  = 5; /* 0 off, 1 rising, 2 falling edge on lowest selected channel */
+const UINT8 MODCON_CAPTURE_LEVEL    = 6; /* trigger level, same convention as analog input value */
+const UINT8 MODCON_CAPTURE_ARM      = 7;
+const UINT8 MODCON_CAPTURE_ABORT    = 8;
+const UINT8 MODCON_CAPTURE_BLOCK    = 9; /* sent only, index of first sample followed by packed 12-bit two's complement samples, +2048 saturates at 2047 */
+
 const UINT8 MODCON_WAVE_STATUS         = 0;
 const UINT8 MODCON_WAVE_WAVEFORM       = 1;
 const UINT8 MODCON_WAVE_FREQUENCY      = 2;
@@ -83,6 +131,20 @@ const UINT8 MODCON_WAVE_OFFSET         = 4;
 const UINT8 MODCON_WAVE_ON             = 5;
 const UINT8 MODCON_WAVE_OFF            = 6;
 const UINT8 MODCON_WAVE_ACTIVE_CHANNEL = 7;
+const UINT8 MODCON_WAVE_UNDERRUN       = 8;
+const UINT8 MODCON_WAVE_ARBITRARY_SLOT = 9;
+const UINT8 MODCON_WAVE_SAMPLE_PERIOD  = 10;
+const UINT8 MODCON_WAVE_NOISE_TYPE     = 11;
+const UINT8 MODCON_WAVE_UPDATE_MODE    = 12;
+const UINT8 MODCON_WAVE_TELEMETRY      = 13;
+
+const UINT8 MODCON_TELEMETRY_LAST  = 0; /* last sample of every window */
+const UINT8 MODCON_TELEMETRY_MEAN  = 1; /* mean of every window */
+const UINT8 MODCON_TELEMETRY_RANGE = 2; /* minimum and maximum of every window */
+const UINT16 MODCON_ROUTINE_WAIT_TICKS = 2; /* longest sleep of routine thread, COP rate must outlast it */
+const UINT8 MODCON_RESPONSE_PACKETS = 6; /* most packets a command answers with, startup and its ACK */
+
+const UINT8 MODCON_SWEEP_PAYLOAD_LENGTH = 6;
 
 const UINT8 MODCON_ARBITRARY_PHASOR_RESET      = 0x00;
 const UINT8 MODCON_ARBITRARY_PHASOR_HARMONIC_1 = 0x01;
@@ -173,6 +235,11 @@ const UINT8 MODCON_ARBITRARY_PHASOR_HARMONIC_F = 0x0F;
 #define DEFAULT_MODCON_MODE 1
 #define ModConMode EEPROM_WORD(CONFIG_EEPROM_ADDRESS_MODCON_MODE)
 
+/**
+ * ModCon baud rate, in MODCON_BAUD_RATE_UNIT. Left erased unless host asks to keep a negotiated one.
+ */
+#define ModConBaudRate EEPROM_WORD(CONFIG_EEPROM_ADDRESS_MODCON_BAUD_RATE)
+
 /**
  * ModCon debug
  */
@@ -192,32 +259,36 @@ const UINT8 MODCON_ARBITRARY_PHASOR_HARMONIC_F = 0x0F;
 #define ModConHMIContrast EEPROM_WORD(CONFIG_EEPROM_ADDRESS_HMI_CONTRAST)
 
 /**
- * \fn BOOL HandleModConStartup(void)
+ * \fn BOOL HandleModConStartup(const TPacket* const packetPtr)
  * \brief Builds packets that are necessary for startup information and places them into transmit buffer. 
+ * \param packetPtr a pointer to received packet
  * \return TRUE if packets were queued for transmission successfully.
  */  
-BOOL HandleModConStartup(void);
+BOOL HandleModConStartup(const TPacket* const packetPtr);
 
 /**
- * \fn BOOL HandleModConSpecial(void)
+ * \fn BOOL HandleModConSpecial(const TPacket* const packetPtr)
  * \brief response to ModCon special commands. 
+ * \param packetPtr a pointer to received packet
  * \return TRUE if the command has been executed successfully.
  */
-BOOL HandleModConSpecial(void);
+BOOL HandleModConSpecial(const TPacket* const packetPtr);
 
 /**
- * \fn BOOL HandleModConProtocolMode(void)
+ * \fn BOOL HandleModConProtocolMode(const TPacket* const packetPtr)
  * \brief response to ModCon protocol mode commands. 
+ * \param packetPtr a pointer to received packet
  * \return TRUE if the command has been executed successfully.
  */
-BOOL HandleModConProtocolMode(void);
+BOOL HandleModConProtocolMode(const TPacket* const packetPtr);
 
 /**
- * \fn BOOL HandleModConNumber(void)
+ * \fn BOOL HandleModConNumber(const TPacket* const packetPtr)
  * \brief response to ModCon number commands. 
+ * \param packetPtr a pointer to received packet
  * \return TRUE if the command has been executed successfully.
  */
-BOOL HandleModConNumber(void);
+BOOL HandleModConNumber(const TPacket* const packetPtr);
 
 /**
  * \fn BOOL HandleModConUptime(void)
@@ -227,11 +298,36 @@ BOOL HandleModConNumber(void);
 BOOL HandleModConUptime(void);
 
 /**
- * \fn BOOL HandleModConMode(void)
+ * \fn BOOL HandleModConMode(const TPacket* const packetPtr)
  * \brief response to ModCon mode commands. 
+ * \param packetPtr a pointer to received packet
+ * \return TRUE if the command has been executed successfully.
+ */
+BOOL HandleModConMode(const TPacket* const packetPtr);
+
+/**
+ * \fn BOOL HandleModConBaudRate(const TPacket* const packetPtr)
+ * \brief response to ModCon baud rate commands. 
+ * \param packetPtr a pointer to received packet
+ * \return TRUE if the command has been executed successfully.
+ */
+BOOL HandleModConBaudRate(const TPacket* const packetPtr);
+
+/**
+ * \fn BOOL HandleModConFraming(const TPacket* const packetPtr)
+ * \brief response to ModCon framing commands. 
+ * \param packetPtr a pointer to received packet
+ * \return TRUE if the command has been executed successfully.
+ */
+BOOL HandleModConFraming(const TPacket* const packetPtr);
+
+/**
+ * \fn BOOL HandleModConTxDrops(const TPacket* const packetPtr)
+ * \brief response to ModCon transmit drops commands. 
+ * \param packetPtr a pointer to received packet
  * \return TRUE if the command has been executed successfully.
  */
-BOOL HandleModConMode(void);
+BOOL HandleModConTxDrops(const TPacket* const packetPtr);
 
 /**
  * \fn BOOL HandleModConAnalogInputValue(const TAnalogChannel channelNb)
@@ -244,39 +340,75 @@ BOOL HandleModConAnalogInputValue(const TAnalogChannel channelNb);
 BOOL HandleModConAnalogOutputValue(const TAnalogChannel channelNb);
 
 /**
- * \fn BOOL HandleModConEEPROMProgram(void)
+ * \fn BOOL HandleModConEEPROMProgram(const TPacket* const packetPtr)
  * \brief Program a byte in EEPROM by given address.
+ * \param packetPtr a pointer to received packet
  * \return TRUE if EEPROM program successfully. 
  */
-BOOL HandleModConEEPROMProgram(void);
+BOOL HandleModConEEPROMProgram(const TPacket* const packetPtr);
 
 /**
- * \fn BOOL HandleModConEEPROMGet(void)
+ * \fn BOOL HandleModConEEPROMGet(const TPacket* const packetPtr)
  * \brief Return byte value of given EEPROM address.
+ * \param packetPtr a pointer to received packet
  * \return TRUE if address is validated and the packet was queued for transmission successfully.
  */
-BOOL HandleModConEEPROMGet(void);
+BOOL HandleModConEEPROMGet(const TPacket* const packetPtr);
 
 /**
- * \fn BOOL HandleModConWave(void)
+ * \fn BOOL HandleModConWave(const TPacket* const packetPtr)
  * \brief
+ * \param packetPtr a pointer to received packet
  * \return
  */
-BOOL HandleModConWave(void);
+BOOL HandleModConWave(const TPacket* const packetPtr);
 
 /**
- * \fn BOOL HandleModConArbitraryWave(void)
+ * \fn BOOL HandleModConArbitraryWave(const TPacket* const packetPtr)
  * \brief
+ * \param packetPtr a pointer to received packet
  * \return
  */
-BOOL HandleModConArbitraryWave(void);
+BOOL HandleModConArbitraryWave(const TPacket* const packetPtr);
 
 /**
- * \fn BOOL HandleModConArbitraryPhasor(void)
+ * \fn BOOL HandleModConArbitraryPhasor(const TPacket* const packetPtr)
  * \brief
+ * \param packetPtr a pointer to received packet
  * \return
  */
-BOOL HandleModConArbitraryPhasor(void);
+BOOL HandleModConArbitraryPhasor(const TPacket* const packetPtr);
+
+/**
+ * \fn BOOL HandleModConSweep(const TPacket* const packetPtr)
+ * \brief Handles frequency sweep packet
+ * \param packetPtr a pointer to received packet
+ * \return TRUE if sweep was started or stopped
+ */
+BOOL HandleModConSweep(const TPacket* const packetPtr);
+
+/**
+ * \fn BOOL HandleModConAnalogCapture(const TPacket* const packetPtr)
+ * \brief response to ModCon analog capture commands. 
+ * \param packetPtr a pointer to received packet
+ * \return TRUE if the command has been executed successfully.
+ */
+BOOL HandleModConAnalogCapture(const TPacket* const packetPtr);
+
+/**
+ * \fn BOOL HandleModConArbitraryBlock(const TPacket* const packetPtr)
+ * \brief Handles block of packed arbitrary wave samples
+ * \param packetPtr a pointer to received packet
+ * \return TRUE if block was intact and stored
+ */
+BOOL HandleModConArbitraryBlock(const TPacket* const packetPtr);
+
+/**
+ * \fn UINT16 ModConPayloadLength(const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3)
+ * \brief Tells packet module how many payload bytes follow given packet
+ * \return payload length in bytes
+ */
+UINT16 ModConPayloadLength(const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3);
 
 /**
  * \fn void Initialize(void)
@@ -6,9 +6,65 @@
  */
 #include "packet.h"
 #include "SCI.h"
+#include "OS.h"
 
 /* define and initialize our externs */
 TPacket Packet = { 0 };
+UINT8 Packet_Payload[PACKET_PAYLOAD_SIZE] = { 0 };
+UINT16 Packet_PayloadLength = 0;
+
+#define PACKET_SIZE 5 /* command, three parameters and checksum */
+
+#define PACKET_SYNC           0xA5   /* first byte of every framed packet */
+#define PACKET_NB_PARAMETERS  3      /* framed body starts with the three parameters */
+#define PACKET_FRAME_OVERHEAD 6      /* sync, length, command and CRC */
+#define PACKET_CRC_INITIAL    0xFFFF
+
+static TPacketPayloadLengthRoutine payloadLengthRoutinePtr = (TPacketPayloadLengthRoutine) 0x0000;
+
+static TPacketReceivedRoutine receivedRoutinePtr = (TPacketReceivedRoutine) 0x0000;
+
+static volatile TPacketFraming framing = PACKET_FRAMING_V1; /* receive interrupt reads it */
+static TPacketFraming nextFraming = PACKET_FRAMING_V1;
+
+static TPacketHandler handlers[PACKET_NB_COMMANDS] = { 0 };
+
+/* CRC-16 lookup table, polynomial 0x1021 */
+static const UINT16 CRCTable[256] =
+{
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+  0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+  0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+  0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+  0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+  0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+  0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+  0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+  0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+  0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+  0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+  0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+  0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+  0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+  0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+  0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+  0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+  0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+  0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+  0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+  0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+  0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+  0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+  0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+  0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+  0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+  0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+  0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+  0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+  0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+  0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
 
 /* states of packet receive state machine */
 typedef enum 
@@ -18,9 +74,47 @@ typedef enum
   STATE_2,
   STATE_3,
   STATE_4,
-  STATE_5        
+  STATE_5 /* streaming payload */
 } PACKET_STATE;
 
+/* states of framed packet receive state machine */
+typedef enum
+{
+  FRAME_STATE_SYNC,
+  FRAME_STATE_LENGTH_LO,
+  FRAME_STATE_LENGTH_HI,
+  FRAME_STATE_COMMAND,
+  FRAME_STATE_PARAMETERS,
+  FRAME_STATE_PAYLOAD,
+  FRAME_STATE_CRC_LO,
+  FRAME_STATE_CRC_HI
+} FRAME_STATE;
+
+typedef struct
+{
+  TPacket packet;
+  UINT16 payloadLength;
+} TPacketQueueEntry;
+
+/* packets parsed by receive interrupt, it is the only producer and Packet_Get the only consumer */
+static struct
+{
+  TPacketQueueEntry entries[PACKET_QUEUE_SIZE];
+  volatile UINT8 head, tail; /* free running */
+} PacketQueue;
+
+/* Packet_Payload holds a queued or handed out payload, payloads received meanwhile wait in SCI receive FIFO */
+static volatile BOOL isPayloadBusy = bFALSE;
+static BOOL isPayloadHandedOut = bFALSE;
+
+/**
+ * \fn BOOL PacketReceive(const UINT8 data)
+ * \brief Feeds one received byte into the state machine of current framing. Called by SCI receive interrupt.
+ * \param data received byte
+ * \return FALSE if the byte is refused as payload buffer is busy
+ */
+BOOL PacketReceive(const UINT8 data);
+
 /**
  * \fn UINT8 Packet_Checksum(const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3)
  * \brief Generates a checksum result of four given bytes.
@@ -35,6 +129,18 @@ UINT8 Packet_Checksum(const UINT8 command, const UINT8 parameter1, const UINT8 p
   return (command ^ parameter1 ^ parameter2 ^ parameter3); 
 }
 
+/**
+ * \fn UINT16 Packet_CRC(const UINT16 crc, const UINT8 data)
+ * \brief Feeds one byte into a CRC-16, start with 0xFFFF.
+ * \param crc CRC of bytes so far
+ * \param data next byte
+ * \return CRC including given byte
+ */
+UINT16 Packet_CRC(const UINT16 crc, const UINT8 data)
+{
+  return (crc << 8) ^ CRCTable[(UINT8)(crc >> 8) ^ data];
+}
+
 /**
  * \fn BOOL Packet_Setup(const UINT32 baudRate, const UINT32 busClk)
  * \brief Initializes the packets by calling the initialization routines of the supporting software modules.
@@ -45,83 +151,324 @@ UINT8 Packet_Checksum(const UINT8 command, const UINT8 parameter1, const UINT8 p
 BOOL Packet_Setup(const UINT32 baudRate, const UINT32 busClk)
 {
   SCI_Setup(baudRate, busClk);
-  return bTRUE; /* no extra configs for now so we leave it here */
+  SCI_AttachReceiveRoutine(&PacketReceive); /* packets are parsed as bytes come in */
+  return bTRUE;
 }
 
 /**
- * \fn BOOL Packet_Get(void)
- * \brief Attempts to get a packet from the received data.
- * \return TRUE if a valid packet was received
+ * \fn void PacketEnqueue(const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3, const UINT16 payloadLength)
+ * \brief Queues a received packet and tells the attached routine about it. Packet is dropped if the queue is full.
+ * \param command command byte
+ * \param parameter1 first parameter byte
+ * \param parameter2 second parameter byte
+ * \param parameter3 third parameter byte
+ * \param payloadLength number of payload bytes in Packet_Payload
  */
-BOOL Packet_Get(void)
+void PacketEnqueue(const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3, const UINT16 payloadLength)
 {
-  /* temps for packet receive state machine */
-  static PACKET_STATE state = STATE_1;
-  static UINT8 command = 0, parameter1 = 0, parameter2 = 0, parameter3 = 0, checksum = 0;
+  TPacketQueueEntry* entryPtr = (TPacketQueueEntry*) 0x0000;
+  
+  /* host sees no answer and repeats it */
+  if ((UINT8)(PacketQueue.tail - PacketQueue.head) >= PACKET_QUEUE_SIZE)
+  {
+    return;
+  }
+  
+  entryPtr = &PacketQueue.entries[PacketQueue.tail & (PACKET_QUEUE_SIZE - 1)];
+  entryPtr->packet.command = command;
+  entryPtr->packet.parameters.separate.parameter1 = parameter1;
+  entryPtr->packet.parameters.separate.parameter2 = parameter2;
+  entryPtr->packet.parameters.separate.parameter3 = parameter3;
+  entryPtr->payloadLength = payloadLength;
+  
+  if (payloadLength)
+  {
+    isPayloadBusy = bTRUE;
+  }
+  
+  /* entry is complete before consumer can see it */
+  ++PacketQueue.tail;
+  
+  if (receivedRoutinePtr)
+  {
+    receivedRoutinePtr();
+  }
+}
 
-#ifdef NO_INTERRUPT    
-  SCI_Poll();
-#endif  
+/**
+ * \fn BOOL PacketReceiveV1(const UINT8 data)
+ * \brief Feeds one received byte into packet receive state machine.
+ * \param data received byte
+ * \return FALSE if the byte is refused as payload buffer is busy, it is to be fed again later
+ */
+BOOL PacketReceiveV1(const UINT8 data)
+{
+  /* temps for packet receive state machine */
+  static PACKET_STATE state = STATE_0;
+  static UINT8 command = 0, parameter1 = 0, parameter2 = 0, parameter3 = 0;
+  static UINT16 payloadIndex = 0, payloadLength = 0;
+  static UINT32 lastTime = 0;
+  static BOOL isHeld = bFALSE; /* bytes after a refused one come out of SCI receive FIFO, their gaps tell nothing */
+  const UINT32 now = OS_TimeGet();
+  
+  /* payload carries no framing of its own, a host that gave up on it halfway would have its next packets taken as payload */
+  if (state == STATE_5 && !isHeld && now - lastTime > PACKET_PAYLOAD_TIMEOUT)
+  {
+    state = STATE_0; /* partial payload is dropped, byte starts a new packet */
+  }
+  lastTime = now;
+  isHeld = bFALSE;
+  
   switch(state)
   {
     case STATE_0:
-      if (SCI_InChar(&command))
+      command = data;
+      state = STATE_1;
+      break;
+    case STATE_1:
+      parameter1 = data;
+      state = STATE_2;
+      break;
+    case STATE_2:
+      parameter2 = data;
+      state = STATE_3;
+      break;
+    case STATE_3:
+      parameter3 = data;
+      state = STATE_4;
+      break;
+    case STATE_4:
+      if (data != Packet_Checksum(command, parameter1, parameter2, parameter3))
+      { /* slide window by one byte to resynchronize */
+        command = parameter1;
+        parameter1 = parameter2;
+        parameter2 = parameter3;
+        parameter3 = data;
+        break;
+      }
+      
+      payloadLength = 0;
+      
+      if (payloadLengthRoutinePtr)
       {
-        state = STATE_1;
+        payloadLength = payloadLengthRoutinePtr(command, parameter1, parameter2, parameter3);
       }
+      
+      /* oversized payload can not be buffered, leave it to handler to reject the packet */
+      if (payloadLength > 0 && payloadLength <= PACKET_PAYLOAD_SIZE)
+      {
+        payloadIndex = 0;
+        state = STATE_5;
+        break;
+      }
+      
+      PacketEnqueue(command, parameter1, parameter2, parameter3, 0);
+      state = STATE_0;
       break;
-    case STATE_1:
-      if (SCI_InChar(&parameter1))
+    case STATE_5:
+      /* last payload is still queued or handed out, this one waits until Packet_Get frees the buffer */
+      if (payloadIndex == 0 && isPayloadBusy)
+      {
+        isHeld = bTRUE;
+        return bFALSE;
+      }
+      
+      Packet_Payload[payloadIndex] = data;
+      
+      if (++payloadIndex < payloadLength)
       {
-        state = STATE_2;
+        break;
       }
+      
+      PacketEnqueue(command, parameter1, parameter2, parameter3, payloadLength);
+      state = STATE_0;
       break;
-    case STATE_2:
-      if (SCI_InChar(&parameter2))
+    default:
+      state = STATE_0;
+      break;
+  }
+  return bTRUE;
+}
+
+/**
+ * \fn BOOL PacketReceiveV2(const UINT8 data)
+ * \brief Feeds one received byte into framed packet receive state machine.
+ * \param data received byte
+ * \return FALSE if the byte is refused as payload buffer is busy, it is to be fed again later
+ */
+BOOL PacketReceiveV2(const UINT8 data)
+{
+  /* temps for framed packet receive state machine */
+  static FRAME_STATE state = FRAME_STATE_SYNC;
+  static UINT8 command = 0, parameters[PACKET_NB_PARAMETERS] = { 0 };
+  static UINT16 length = 0, index = 0, payloadLength = 0, crc = 0, receivedCRC = 0;
+  
+  switch(state)
+  {
+    case FRAME_STATE_SYNC:
+      if (data == PACKET_SYNC)
       {
-        state = STATE_3;
+        crc = PACKET_CRC_INITIAL;
+        state = FRAME_STATE_LENGTH_LO;
       }
       break;
-    case STATE_3:
-      if (SCI_InChar(&parameter3))
+    case FRAME_STATE_LENGTH_LO:
+      crc = Packet_CRC(crc, data);
+      length = data;
+      state = FRAME_STATE_LENGTH_HI;
+      break;
+    case FRAME_STATE_LENGTH_HI:
+      crc = Packet_CRC(crc, data);
+      length |= (UINT16)data << 8;
+      
+      /* false sync or a body that can not be buffered, hunt for next sync */
+      if (length > PACKET_NB_PARAMETERS + PACKET_PAYLOAD_SIZE)
       {
-        state = STATE_4;
+        state = FRAME_STATE_SYNC;
+        break;
       }
-      break;            
-    case STATE_4:
-      if (SCI_InChar(&checksum))
+      
+      payloadLength = (length > PACKET_NB_PARAMETERS) ? length - PACKET_NB_PARAMETERS : 0;
+      state = FRAME_STATE_COMMAND;
+      break;
+    case FRAME_STATE_COMMAND:
+      crc = Packet_CRC(crc, data);
+      command = data;
+      
+      /* parameters left out of a short body read as zero */
+      for (index = 0; index < PACKET_NB_PARAMETERS; ++index)
       {
-        state = STATE_5;
+        parameters[index] = 0;
       }
+      index = 0;
+      state = length ? FRAME_STATE_PARAMETERS : FRAME_STATE_CRC_LO;
       break;
-    case STATE_5:
-      if (checksum != Packet_Checksum(command, parameter1, parameter2, parameter3))
+    case FRAME_STATE_PARAMETERS:
+      crc = Packet_CRC(crc, data);
+      parameters[index++] = data;
+      
+      if (index < length && index < PACKET_NB_PARAMETERS)
       {
-        command = parameter1;
-        parameter1 = parameter2;
-        parameter2 = parameter3;
-        parameter3 = checksum;
-        state = STATE_4;                    
+        break;
       }
-      else
+      
+      index = 0;
+      state = payloadLength ? FRAME_STATE_PAYLOAD : FRAME_STATE_CRC_LO;
+      break;
+    case FRAME_STATE_PAYLOAD:
+      /* last payload is still queued or handed out, this one waits until Packet_Get frees the buffer */
+      if (index == 0 && isPayloadBusy)
+      {
+        return bFALSE;
+      }
+      
+      crc = Packet_CRC(crc, data);
+      Packet_Payload[index] = data;
+      
+      if (++index >= payloadLength)
+      {
+        state = FRAME_STATE_CRC_LO;
+      }
+      break;
+    case FRAME_STATE_CRC_LO:
+      receivedCRC = data;
+      state = FRAME_STATE_CRC_HI;
+      break;
+    case FRAME_STATE_CRC_HI:
+      receivedCRC |= (UINT16)data << 8;
+      state = FRAME_STATE_SYNC;
+      
+      /* corrupted frame is dropped whole, host sees no answer and repeats it */
+      if (receivedCRC == crc)
       {
-        Packet_Command = command;
-        Packet_Parameter1 = parameter1;
-        Packet_Parameter2 = parameter2;
-        Packet_Parameter3 = parameter3;
-        state = STATE_0;
-        return bTRUE;
+        PacketEnqueue(command, parameters[0], parameters[1], parameters[2], payloadLength);
       }
       break;
     default:
+      state = FRAME_STATE_SYNC;
       break;
   }
-  return bFALSE;
+  return bTRUE;
+}
+
+/**
+ * \fn BOOL PacketReceive(const UINT8 data)
+ * \brief Feeds one received byte into the state machine of current framing. Called by SCI receive interrupt.
+ * \param data received byte
+ * \return FALSE if the byte is refused as payload buffer is busy
+ */
+BOOL PacketReceive(const UINT8 data)
+{
+  if (framing == PACKET_FRAMING_V2)
+  {
+    return PacketReceiveV2(data);
+  }
+  return PacketReceiveV1(data);
+}
+
+/**
+ * \fn BOOL Packet_Get(void)
+ * \brief Takes the oldest packet parsed by the receive interrupt.
+ * \return TRUE if a valid packet was received
+ * \note Payload of the packet stays in Packet_Payload until next call.
+ */
+BOOL Packet_Get(void)
+{
+  TPacketQueueEntry* entryPtr = (TPacketQueueEntry*) 0x0000;
+  
+  /* framing asked for while handling last packet starts here, between packets both ways */
+  framing = nextFraming;
+  
+  /* caller is done with payload handed out last time, a payload held back meanwhile can come in now */
+  if (isPayloadHandedOut)
+  {
+    isPayloadHandedOut = bFALSE;
+    isPayloadBusy = bFALSE;
+    SCI_ResumeReceive();
+  }
+  
+#ifdef NO_INTERRUPT    
+  SCI_Poll();
+#endif  
+
+  if (PacketQueue.head == PacketQueue.tail)
+  {
+    return bFALSE;
+  }
+  
+  entryPtr = &PacketQueue.entries[PacketQueue.head & (PACKET_QUEUE_SIZE - 1)];
+  Packet = entryPtr->packet;
+  Packet_PayloadLength = entryPtr->payloadLength;
+  isPayloadHandedOut = (entryPtr->payloadLength > 0);
+  
+  /* entry can be reused only after it has been copied */
+  ++PacketQueue.head;
+  return bTRUE;
+}
+
+/**
+ * \fn void Packet_AttachReceivedRoutine(const TPacketReceivedRoutine routine)
+ * \brief Attaches a routine to be told whenever a packet has been queued, e.g. to wake up the thread calling Packet_Get.
+ * \param routine received routine, it runs in interrupt context unless NO_INTERRUPT is defined
+ */
+void Packet_AttachReceivedRoutine(const TPacketReceivedRoutine routine)
+{
+  receivedRoutinePtr = routine;
+}
+
+/**
+ * \fn void Packet_AttachPayloadLengthRoutine(TPacketPayloadLengthRoutine routine)
+ * \brief Attaches a routine to tell payload length of received packets, packets with payload are streamed into Packet_Payload.
+ * \param routine
+ */
+void Packet_AttachPayloadLengthRoutine(TPacketPayloadLengthRoutine routine)
+{
+  payloadLengthRoutinePtr = routine;
 }
 
 /**
  * \fn BOOL Packet_Put(const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3)
- * \brief Builds a packet and places it in the transmit FIFO buffer.
+ * \brief Builds a packet and places it in the control transmit queue, meant for command responses.
  * \param command command byte
  * \param parameter1 first parameter byte
  * \param parameter2 second parameter byte
@@ -130,9 +477,221 @@ BOOL Packet_Get(void)
  */
 BOOL Packet_Put(const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3)
 {  
-  return SCI_OutChar(command) &&
-         SCI_OutChar(parameter1) &&
-         SCI_OutChar(parameter2) &&
-         SCI_OutChar(parameter3) &&
-         SCI_OutChar(Packet_Checksum(command, parameter1, parameter2, parameter3));
+  return Packet_PutPayload(SCI_TX_CONTROL, command, parameter1, parameter2, parameter3, (const UINT8*) 0x0000, 0);
+}
+
+/**
+ * \fn BOOL Packet_PutBulk(const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3)
+ * \brief Builds a packet and places it in the bulk transmit queue, meant for streaming data.
+ * \param command command byte
+ * \param parameter1 first parameter byte
+ * \param parameter2 second parameter byte
+ * \param parameter3 third parameter byte
+ * \return TRUE if a valid packet was queued for transmission successfully
+ */
+BOOL Packet_PutBulk(const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3)
+{  
+  return Packet_PutPayload(SCI_TX_BULK, command, parameter1, parameter2, parameter3, (const UINT8*) 0x0000, 0);
+}
+
+/**
+ * \fn BOOL Packet_PutPayload(const TSCITxQueue queue, const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3, const UINT8* const payloadPtr, const UINT16 payloadLength)
+ * \brief Builds a packet followed by given payload and places it in given transmit queue.
+ *        In framing v1 payload bytes follow the checksum as they are, in framing v2 they are part of the frame.
+ * \param queue transmit queue
+ * \param command command byte
+ * \param parameter1 first parameter byte
+ * \param parameter2 second parameter byte
+ * \param parameter3 third parameter byte
+ * \param payloadPtr a pointer to payload bytes
+ * \param payloadLength number of payload bytes
+ * \return TRUE if a valid packet was queued for transmission successfully
+ */
+BOOL Packet_PutPayload(const TSCITxQueue queue, const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3, const UINT8* const payloadPtr, const UINT16 payloadLength)
+{
+  TSCIReservation reservation;
+  UINT16 index = 0, offset = 0, length = 0, crc = PACKET_CRC_INITIAL;
+  UINT8 header[PACKET_NB_PARAMETERS + 3]; /* length, command and parameters in framing v2, command, parameters and checksum in v1 */
+  UINT8 nbHeaderBytes = 0;
+  
+  if (payloadLength && !payloadPtr)
+  {
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_INVALID_POINTER);
+#endif
+    return bFALSE;
+  }
+  
+  if (framing == PACKET_FRAMING_V2)
+  {
+    length = PACKET_NB_PARAMETERS + payloadLength;
+    header[nbHeaderBytes++] = (UINT8)length;
+    header[nbHeaderBytes++] = (UINT8)(length >> 8);
+  }
+  header[nbHeaderBytes++] = command;
+  header[nbHeaderBytes++] = parameter1;
+  header[nbHeaderBytes++] = parameter2;
+  header[nbHeaderBytes++] = parameter3;
+  
+  /* whole packet or nothing, bytes are built in place and nobody sees them before commit */
+  if (!SCI_OutReserve(queue, (framing == PACKET_FRAMING_V2 ? PACKET_FRAME_OVERHEAD + PACKET_NB_PARAMETERS : PACKET_SIZE) + payloadLength, &reservation))
+  {
+    return bFALSE;
+  }
+  
+  if (framing == PACKET_FRAMING_V2)
+  {
+    SCI_OutWrite(&reservation, offset++, PACKET_SYNC);
+    
+    for (index = 0; index < nbHeaderBytes; ++index)
+    {
+      crc = Packet_CRC(crc, header[index]);
+    }
+    for (index = 0; index < payloadLength; ++index)
+    {
+      crc = Packet_CRC(crc, payloadPtr[index]);
+    }
+  }
+  else
+  {
+    header[nbHeaderBytes++] = Packet_Checksum(command, parameter1, parameter2, parameter3);
+  }
+  
+  /* header and payload go in as blocks, framing v2 closes with its CRC */
+  SCI_OutWriteBlock(&reservation, offset, header, nbHeaderBytes);
+  offset += nbHeaderBytes;
+  
+  if (payloadLength)
+  {
+    SCI_OutWriteBlock(&reservation, offset, payloadPtr, payloadLength);
+    offset += payloadLength;
+  }
+  
+  if (framing == PACKET_FRAMING_V2)
+  {
+    SCI_OutWrite(&reservation, offset++, (UINT8)crc);
+    SCI_OutWrite(&reservation, offset++, (UINT8)(crc >> 8));
+  }
+  
+  SCI_OutCommit(&reservation);
+  return bTRUE;
+}
+
+/**
+ * \fn UINT16 PacketQueuedSize(const TSCITxQueue queue, const UINT16 payloadLength)
+ * \brief Tells how many bytes of given transmit queue a packet takes in current framing
+ * \param queue transmit queue
+ * \param payloadLength number of payload bytes
+ * \return number of bytes
+ */
+UINT16 PacketQueuedSize(const TSCITxQueue queue, const UINT16 payloadLength)
+{
+  UINT16 nbBytes = ((framing == PACKET_FRAMING_V2) ? PACKET_FRAME_OVERHEAD + PACKET_NB_PARAMETERS : PACKET_SIZE) + payloadLength;
+  
+  if (queue == SCI_TX_BULK)
+  {
+    nbBytes += SCI_TX_BULK_HEADER_SIZE;
+  }
+  return nbBytes;
+}
+
+/**
+ * \fn UINT16 Packet_Room(const TSCITxQueue queue)
+ * \brief Tells how many packets can be placed in given transmit queue right now
+ * \param queue transmit queue
+ * \return number of packets
+ */
+UINT16 Packet_Room(const TSCITxQueue queue)
+{
+  return SCI_OutFree(queue) / PacketQueuedSize(queue, 0);
+}
+
+/**
+ * \fn BOOL Packet_WouldBlock(const TSCITxQueue queue, const UINT16 nbPackets)
+ * \brief Tells whether given number of packets would not fit in given transmit queue right now
+ * \param queue transmit queue
+ * \param nbPackets number of packets about to be put
+ * \return TRUE if the caller should come back later
+ */
+BOOL Packet_WouldBlock(const TSCITxQueue queue, const UINT16 nbPackets)
+{
+  return Packet_Room(queue) < nbPackets;
+}
+
+/**
+ * \fn BOOL Packet_PayloadWouldBlock(const TSCITxQueue queue, const UINT16 payloadLength)
+ * \brief Tells whether a packet with given payload length would not fit in given transmit queue right now
+ * \param queue transmit queue
+ * \param payloadLength number of payload bytes about to be put
+ * \return TRUE if the caller should come back later
+ */
+BOOL Packet_PayloadWouldBlock(const TSCITxQueue queue, const UINT16 payloadLength)
+{
+  return SCI_OutFree(queue) < PacketQueuedSize(queue, payloadLength);
+}
+
+/**
+ * \fn void Packet_SetFraming(const TPacketFraming newFraming)
+ * \brief Changes packet framing both ways, from next Packet_Get call on. Packets put before then keep current framing.
+ * \param newFraming framing to change to
+ */
+void Packet_SetFraming(const TPacketFraming newFraming)
+{
+  nextFraming = newFraming;
+}
+
+/**
+ * \fn TPacketFraming Packet_GetFraming(void)
+ * \brief Tells packet framing in use, or about to be from next Packet_Get call on
+ * \return packet framing
+ */
+TPacketFraming Packet_GetFraming(void)
+{
+  return nextFraming;
+}
+
+/**
+ * \fn BOOL Packet_RegisterHandler(const UINT8 command, const TPacketHandler handler)
+ * \brief Registers a routine to handle packets of given command, a later registration replaces it.
+ * \param command command byte
+ * \param handler handler routine, 0 to unregister
+ * \return TRUE if the handler was registered
+ */
+BOOL Packet_RegisterHandler(const UINT8 command, const TPacketHandler handler)
+{
+  if (command >= PACKET_NB_COMMANDS)
+  {
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_INVALID_ARGUMENT);
+#endif
+    return bFALSE;
+  }
+  
+  handlers[command] = handler;
+  return bTRUE;
+}
+
+/**
+ * \fn BOOL Packet_Dispatch(const TPacket* const packetPtr)
+ * \brief Hands given packet to the handler registered for its command.
+ * \param packetPtr a pointer to received packet
+ * \return TRUE if a handler was registered and it handled the packet
+ */
+BOOL Packet_Dispatch(const TPacket* const packetPtr)
+{
+  if (!packetPtr)
+  {
+#ifndef NO_DEBUG
+    DEBUG(__LINE__, ERR_INVALID_POINTER);
+#endif
+    return bFALSE;
+  }
+  
+  /* unknown commands are refused like a handler would */
+  if (packetPtr->command >= PACKET_NB_COMMANDS || !handlers[packetPtr->command])
+  {
+    return bFALSE;
+  }
+  
+  return handlers[packetPtr->command](packetPtr);
 }
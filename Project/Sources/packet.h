@@ -8,6 +8,7 @@
 #define PACKET_H
 
 #include "global.h"
+#include "SCI.h"
 
 /* Packet structure */
 typedef struct
@@ -41,14 +42,87 @@ typedef struct
 #define Packet_Parameter12 Packet.parameters.combined12.parameter12
 #define Packet_Parameter23 Packet.parameters.combined23.parameter23
 
+#define Packet_CommandOf(packetPtr)     ((packetPtr)->command)
+#define Packet_Parameter1Of(packetPtr)  ((packetPtr)->parameters.separate.parameter1)
+#define Packet_Parameter2Of(packetPtr)  ((packetPtr)->parameters.separate.parameter2)
+#define Packet_Parameter3Of(packetPtr)  ((packetPtr)->parameters.separate.parameter3)
+#define Packet_Parameter12Of(packetPtr) ((packetPtr)->parameters.combined12.parameter12)
+#define Packet_Parameter23Of(packetPtr) ((packetPtr)->parameters.combined23.parameter23)
+
+/**
+ * Number of commands handlers can be registered for, top bit of command byte is left to acknowledgement
+ */
+#define PACKET_NB_COMMANDS 128
+
+/**
+ * Packet payload capacity, enough for a full arbitrary wave of packed 12-bit samples
+ */
+#ifndef CONFIG_PACKET_PAYLOAD_SIZE
+#define PACKET_PAYLOAD_SIZE 384 /* fallback plan */
+#warning "PACKET_PAYLOAD_SIZE using fallback setting 384"
+#else
+#define PACKET_PAYLOAD_SIZE CONFIG_PACKET_PAYLOAD_SIZE
+#endif
+
+/**
+ * Longest gap in ticks between two bytes of a framing v1 payload before it is dropped
+ */
+#ifndef CONFIG_PACKET_PAYLOAD_TIMEOUT
+#define PACKET_PAYLOAD_TIMEOUT 2 /* fallback plan */
+#warning "PACKET_PAYLOAD_TIMEOUT using fallback setting 2"
+#else
+#define PACKET_PAYLOAD_TIMEOUT CONFIG_PACKET_PAYLOAD_TIMEOUT
+#endif
+
+/**
+ * Capacity of received packet queue, power of two
+ */
+#ifndef CONFIG_PACKET_QUEUE_SIZE
+#define PACKET_QUEUE_SIZE 8 /* fallback plan */
+#warning "PACKET_QUEUE_SIZE using fallback setting 8"
+#else
+#define PACKET_QUEUE_SIZE CONFIG_PACKET_QUEUE_SIZE
+#endif
+
+/**
+ * \brief Routine tells how many payload bytes follow a packet, 0 if it has none
+ */
+typedef UINT16 (*TPacketPayloadLengthRoutine)(const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3);
+
+/**
+ * \brief Routine handles a received packet, payload if any is in Packet_Payload
+ */
+typedef BOOL (*TPacketHandler)(const TPacket* const packetPtr);
+
+/**
+ * \brief Routine is told a packet has been queued
+ */
+typedef void (*TPacketReceivedRoutine)(void);
+
 typedef enum
 {
   PACKET_ASYNCHRONOUS,
   PACKET_SYNCHRONOUS
 } TPacketMode;
 
+typedef enum
+{
+  PACKET_FRAMING_V1, /* command, three parameters and XOR checksum */
+  PACKET_FRAMING_V2  /* sync, 16-bit length, command, three parameters and payload, CRC-16 */
+} TPacketFraming;
+
 extern TPacket Packet;
 
+/**
+ * \brief payload of last received packet
+ */
+extern UINT8 Packet_Payload[PACKET_PAYLOAD_SIZE];
+
+/**
+ * \brief payload length of last received packet
+ */
+extern UINT16 Packet_PayloadLength;
+
 /**
  * \fn UINT8 Packet_Checksum(const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3)
  * \brief Generates a checksum result of four given bytes.
@@ -60,6 +134,15 @@ extern TPacket Packet;
  */
 UINT8 Packet_Checksum(const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3);
 
+/**
+ * \fn UINT16 Packet_CRC(const UINT16 crc, const UINT8 data)
+ * \brief Feeds one byte into a CRC-16, start with 0xFFFF.
+ * \param crc CRC of bytes so far
+ * \param data next byte
+ * \return CRC including given byte
+ */
+UINT16 Packet_CRC(const UINT16 crc, const UINT8 data);
+
 /**
  * \fn BOOL Packet_Setup(const UINT32 baudRate, const UINT32 busClk)
  * \brief Initializes the packets by calling the initialization routines of the supporting software modules.
@@ -71,14 +154,29 @@ BOOL Packet_Setup(const UINT32 baudRate, const UINT32 busClk);
 
 /**
  * \fn BOOL Packet_Get(void)
- * \brief Attempts to get a packet from the received data.
+ * \brief Takes the oldest packet parsed by the receive interrupt.
  * \return TRUE if a valid packet was received
+ * \note Payload of the packet stays in Packet_Payload until next call.
  */
 BOOL Packet_Get(void);
 
+/**
+ * \fn void Packet_AttachReceivedRoutine(const TPacketReceivedRoutine routine)
+ * \brief Attaches a routine to be told whenever a packet has been queued, e.g. to wake up the thread calling Packet_Get.
+ * \param routine received routine, it runs in interrupt context unless NO_INTERRUPT is defined
+ */
+void Packet_AttachReceivedRoutine(const TPacketReceivedRoutine routine);
+
+/**
+ * \fn void Packet_AttachPayloadLengthRoutine(TPacketPayloadLengthRoutine routine)
+ * \brief Attaches a routine to tell payload length of received packets, packets with payload are streamed into Packet_Payload.
+ * \param routine
+ */
+void Packet_AttachPayloadLengthRoutine(TPacketPayloadLengthRoutine routine);
+
 /**
  * \fn BOOL Packet_Put(const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3)
- * \brief Builds a packet and places it in the transmit FIFO buffer.
+ * \brief Builds a packet and places it in the control transmit queue, meant for command responses.
  * \param command command byte
  * \param parameter1 first parameter byte
  * \param parameter2 second parameter byte
@@ -87,4 +185,87 @@ BOOL Packet_Get(void);
  */
 BOOL Packet_Put(const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3);
 
+/**
+ * \fn BOOL Packet_PutBulk(const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3)
+ * \brief Builds a packet and places it in the bulk transmit queue, meant for streaming data.
+ * \param command command byte
+ * \param parameter1 first parameter byte
+ * \param parameter2 second parameter byte
+ * \param parameter3 third parameter byte
+ * \return TRUE if a valid packet was queued for transmission successfully
+ */
+BOOL Packet_PutBulk(const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3);
+
+/**
+ * \fn BOOL Packet_PutPayload(const TSCITxQueue queue, const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3, const UINT8* const payloadPtr, const UINT16 payloadLength)
+ * \brief Builds a packet followed by given payload and places it in given transmit queue.
+ *        In framing v1 payload bytes follow the checksum as they are, in framing v2 they are part of the frame.
+ * \param queue transmit queue
+ * \param command command byte
+ * \param parameter1 first parameter byte
+ * \param parameter2 second parameter byte
+ * \param parameter3 third parameter byte
+ * \param payloadPtr a pointer to payload bytes
+ * \param payloadLength number of payload bytes
+ * \return TRUE if a valid packet was queued for transmission successfully
+ */
+BOOL Packet_PutPayload(const TSCITxQueue queue, const UINT8 command, const UINT8 parameter1, const UINT8 parameter2, const UINT8 parameter3, const UINT8* const payloadPtr, const UINT16 payloadLength);
+
+/**
+ * \fn UINT16 Packet_Room(const TSCITxQueue queue)
+ * \brief Tells how many packets can be placed in given transmit queue right now
+ * \param queue transmit queue
+ * \return number of packets
+ */
+UINT16 Packet_Room(const TSCITxQueue queue);
+
+/**
+ * \fn BOOL Packet_WouldBlock(const TSCITxQueue queue, const UINT16 nbPackets)
+ * \brief Tells whether given number of packets would not fit in given transmit queue right now
+ * \param queue transmit queue
+ * \param nbPackets number of packets about to be put
+ * \return TRUE if the caller should come back later
+ */
+BOOL Packet_WouldBlock(const TSCITxQueue queue, const UINT16 nbPackets);
+
+/**
+ * \fn BOOL Packet_PayloadWouldBlock(const TSCITxQueue queue, const UINT16 payloadLength)
+ * \brief Tells whether a packet with given payload length would not fit in given transmit queue right now
+ * \param queue transmit queue
+ * \param payloadLength number of payload bytes about to be put
+ * \return TRUE if the caller should come back later
+ */
+BOOL Packet_PayloadWouldBlock(const TSCITxQueue queue, const UINT16 payloadLength);
+
+/**
+ * \fn void Packet_SetFraming(const TPacketFraming newFraming)
+ * \brief Changes packet framing both ways, from next Packet_Get call on. Packets put before then keep current framing.
+ * \param newFraming framing to change to
+ */
+void Packet_SetFraming(const TPacketFraming newFraming);
+
+/**
+ * \fn TPacketFraming Packet_GetFraming(void)
+ * \brief Tells packet framing in use, or about to be from next Packet_Get call on
+ * \return packet framing
+ */
+TPacketFraming Packet_GetFraming(void);
+
+/**
+ * \fn BOOL Packet_RegisterHandler(const UINT8 command, const TPacketHandler handler)
+ * \brief Registers a routine to handle packets of given command, a later registration replaces it.
+ * \param command command byte
+ * \param handler handler routine, 0 to unregister
+ * \return TRUE if the handler was registered
+ */
+BOOL Packet_RegisterHandler(const UINT8 command, const TPacketHandler handler);
+
+/**
+ * \fn BOOL Packet_Dispatch(const TPacket* const packetPtr)
+ * \brief Hands given packet to the handler registered for its command.
+ * \param packetPtr a pointer to received packet
+ * \return TRUE if a handler was registered and it handled the packet
+ */
+BOOL Packet_Dispatch(const TPacket* const packetPtr);
+
 #endif